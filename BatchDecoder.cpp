@@ -0,0 +1,309 @@
+#include "BatchDecoder.h"
+
+#include <array>
+#include <atomic>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define EKEY_X86
+#endif
+
+namespace Ekey {
+
+namespace {
+
+//Packets are copied into a zero padded block, so the classifiers never read past the end of a datagram
+constexpr size_t blockSize = 64;
+static_assert(HomeLayout::size <= blockSize && MultiLayout::size <= blockSize, "Packets have to fit into one block");
+
+constexpr uint64_t getMask(Field field) {
+    return ((1ULL << field.length) - 1) << field.offset;
+}
+
+constexpr uint64_t getSeparatorMask() {
+    uint64_t mask = 0;
+    for (auto field : HomeLayout::separatedFields) {
+        mask |= 1ULL << (field.offset + field.length);
+    }
+    return mask;
+}
+
+constexpr uint64_t homeDigits = getMask(HomeLayout::packetType) | getMask(HomeLayout::userId) | getMask(HomeLayout::action);
+constexpr uint64_t homeSeparators = getSeparatorMask();
+constexpr uint64_t multiDigits = getMask(MultiLayout::packetType) | getMask(MultiLayout::userId);
+
+//Lookup tables for single character fields, invalid characters map to invalidCode
+constexpr int8_t invalidCode = INT8_MIN;
+using CodeTable = std::array<int8_t, 256>;
+
+constexpr CodeTable getCodeTable(char special1, int8_t code1, char special2, int8_t code2, bool hex) {
+    CodeTable table{};
+    for (auto &code : table) code = invalidCode;
+    for (int i = 0; i <= 9; i++) table['0' + i] = (int8_t)i;
+    if (hex) {
+        for (int i = 0; i < 6; i++) {
+            table['A' + i] = (int8_t)(10 + i);
+            table['a' + i] = (int8_t)(10 + i);
+        }
+    }
+    if (special1) table[(uint8_t)special1] = code1;
+    if (special2) table[(uint8_t)special2] = code2;
+    return table;
+}
+
+constexpr CodeTable fingerCodes = getCodeTable('R', fingerRfid, '-', fingerNone, false);
+constexpr CodeTable relayCodes = getCodeTable('d', relayMultiple, '-', relayNone, false);
+constexpr CodeTable dashCodes = getCodeTable('-', -2, 0, 0, false); //userStateUndefined, keyMain and inputNone
+constexpr CodeTable hexCodes = getCodeTable(0, 0, 0, 0, true);
+static_assert(userStateUndefined == -2 && keyMain == -2 && inputNone == -2, "dashCodes maps \"-\" to -2");
+
+inline int32_t getCode(const CodeTable &table, std::string_view data, Field field) {
+    return table[(uint8_t)data[field.offset]];
+}
+
+inline int32_t getNumber(std::string_view data, Field field) {
+    //Only called for fields whose digits were already validated
+    int32_t value = 0;
+    for (uint8_t i = 0; i < field.length; i++) {
+        value = value * 10 + (data[field.offset + i] - '0');
+    }
+    return value;
+}
+
+//Sets bit i of digits and separators if byte i is a digit or an underscore. Only positions in positions are guaranteed
+//to be classified. The SIMD versions classify whole registers up to size, which costs the same.
+using Classifier = void (*)(const uint8_t *block, size_t size, uint64_t positions, uint64_t &digits, uint64_t &separators);
+
+constexpr std::array<uint8_t, 256> getCharacterClasses() {
+    std::array<uint8_t, 256> classes{};
+    for (int i = '0'; i <= '9'; i++) classes[i] = 1;
+    classes['_'] = 2;
+    return classes;
+}
+
+constexpr std::array<uint8_t, 256> characterClasses = getCharacterClasses();
+
+void classifyScalar(const uint8_t *block, size_t, uint64_t positions, uint64_t &digits, uint64_t &separators) {
+    digits = 0;
+    separators = 0;
+    for (; positions; positions &= positions - 1) {
+        uint32_t i = (uint32_t)__builtin_ctzll(positions);
+        uint64_t characterClass = characterClasses[block[i]];
+        digits |= (characterClass & 1) << i;
+        separators |= (characterClass >> 1) << i;
+    }
+}
+
+#ifdef EKEY_X86
+__attribute__((target("sse2"))) void classifySse2(const uint8_t *block, size_t size, uint64_t, uint64_t &digits, uint64_t &separators) {
+    digits = 0;
+    separators = 0;
+    const __m128i zero = _mm_set1_epi8('0');
+    const __m128i nine = _mm_set1_epi8(9);
+    const __m128i underscore = _mm_set1_epi8('_');
+    for (size_t i = 0; i < size; i += 16) {
+        __m128i bytes = _mm_load_si128((const __m128i *)(block + i));
+        //Bytes below '0' wrap around, so one unsigned comparison checks both bounds
+        __m128i offset = _mm_sub_epi8(bytes, zero);
+        __m128i isDigit = _mm_cmpeq_epi8(_mm_min_epu8(offset, nine), offset);
+        digits |= (uint64_t)(uint32_t)_mm_movemask_epi8(isDigit) << i;
+        separators |= (uint64_t)(uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, underscore)) << i;
+    }
+}
+
+__attribute__((target("avx2"))) void classifyAvx2(const uint8_t *block, size_t size, uint64_t, uint64_t &digits, uint64_t &separators) {
+    digits = 0;
+    separators = 0;
+    const __m256i zero = _mm256_set1_epi8('0');
+    const __m256i nine = _mm256_set1_epi8(9);
+    const __m256i underscore = _mm256_set1_epi8('_');
+    for (size_t i = 0; i < size; i += 32) {
+        __m256i bytes = _mm256_load_si256((const __m256i *)(block + i));
+        __m256i offset = _mm256_sub_epi8(bytes, zero);
+        __m256i isDigit = _mm256_cmpeq_epi8(_mm256_min_epu8(offset, nine), offset);
+        digits |= (uint64_t)(uint32_t)_mm256_movemask_epi8(isDigit) << i;
+        separators |= (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(bytes, underscore)) << i;
+    }
+}
+#endif
+
+bool isSupported(InstructionSet instructionSet) {
+    switch (instructionSet) {
+        case InstructionSet::scalar:
+            return true;
+#ifdef EKEY_X86
+        case InstructionSet::sse2:
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("sse2");
+        case InstructionSet::avx2:
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("avx2");
+#endif
+        default:
+            return false;
+    }
+}
+
+Classifier getClassifier(InstructionSet instructionSet) {
+    switch (instructionSet) {
+#ifdef EKEY_X86
+        case InstructionSet::sse2:
+            return &classifySse2;
+        case InstructionSet::avx2:
+            return &classifyAvx2;
+#endif
+        default:
+            return &classifyScalar;
+    }
+}
+
+std::atomic<InstructionSet> &currentInstructionSet() {
+    static std::atomic<InstructionSet> instructionSet{
+        isSupported(InstructionSet::avx2) ? InstructionSet::avx2 : isSupported(InstructionSet::sse2) ? InstructionSet::sse2 : InstructionSet::scalar};
+    return instructionSet;
+}
+
+}
+
+void HomeColumns::resize(size_t size) {
+    error.resize(size);
+    packetType.resize(size);
+    userId.resize(size);
+    fingerId.resize(size);
+    serialNr.resize(size);
+    action.resize(size);
+    relayId.resize(size);
+}
+
+HomePacket HomeColumns::getPacket(size_t index) const {
+    HomePacket packet;
+    packet.packetType = packetType[index];
+    packet.userId = userId[index];
+    packet.fingerId = fingerId[index];
+    packet.serialNr = serialNr[index];
+    packet.action = action[index];
+    packet.relayId = relayId[index];
+    return packet;
+}
+
+void MultiColumns::resize(size_t size) {
+    error.resize(size);
+    packetType.resize(size);
+    userId.resize(size);
+    userName.resize(size);
+    userState.resize(size);
+    fingerId.resize(size);
+    keyId.resize(size);
+    serialNr.resize(size);
+    readerName.resize(size);
+    action.resize(size);
+    inputId.resize(size);
+}
+
+MultiPacket MultiColumns::getPacket(size_t index) const {
+    MultiPacket packet;
+    packet.packetType = packetType[index];
+    packet.userId = userId[index];
+    packet.userName = userName[index];
+    packet.userState = userState[index];
+    packet.fingerId = fingerId[index];
+    packet.keyId = keyId[index];
+    packet.serialNr = serialNr[index];
+    packet.readerName = readerName[index];
+    packet.action = action[index];
+    packet.inputId = inputId[index];
+    return packet;
+}
+
+InstructionSet BatchDecoder::getInstructionSet() {
+    return currentInstructionSet().load(std::memory_order_relaxed);
+}
+
+bool BatchDecoder::setInstructionSet(InstructionSet instructionSet) {
+    if (!isSupported(instructionSet)) return false;
+    currentInstructionSet().store(instructionSet, std::memory_order_relaxed);
+    return true;
+}
+
+std::string_view BatchDecoder::getInstructionSetName(InstructionSet instructionSet) {
+    switch (instructionSet) {
+        case InstructionSet::scalar:
+            return "scalar";
+        case InstructionSet::sse2:
+            return "sse2";
+        case InstructionSet::avx2:
+            return "avx2";
+    }
+    return "";
+}
+
+void BatchDecoder::decodeHome(const std::string_view *packets, size_t count, HomeColumns &columns) {
+    columns.resize(count);
+    auto classify = getClassifier(getInstructionSet());
+    alignas(32) std::array<uint8_t, blockSize> block{};
+    for (size_t i = 0; i < count; i++) {
+        auto data = packets[i];
+        if (data.size() != HomeLayout::size) {
+            columns.error[i] = ParseError::lengthMismatch;
+            continue;
+        }
+        std::memcpy(block.data(), data.data(), HomeLayout::size);
+        uint64_t digits;
+        uint64_t separators;
+        classify(block.data(), HomeLayout::size, homeDigits | homeSeparators, digits, separators);
+
+        int32_t fingerId = getCode(fingerCodes, data, HomeLayout::fingerId);
+        int32_t relayId = getCode(relayCodes, data, HomeLayout::relayId);
+        //Invalid digits take precedence over invalid separators, like in PacketParser::parseHome()
+        bool validDigits = ((digits & homeDigits) == homeDigits) & (fingerId != invalidCode) & (relayId != invalidCode);
+        bool validSeparators = (separators & homeSeparators) == homeSeparators;
+        columns.error[i] = !validDigits ? ParseError::badDigit : !validSeparators ? ParseError::badSeparator : ParseError::none;
+
+        columns.packetType[i] = getNumber(data, HomeLayout::packetType);
+        columns.userId[i] = getNumber(data, HomeLayout::userId);
+        columns.fingerId[i] = fingerId;
+        columns.serialNr[i] = data.substr(HomeLayout::serialNr.offset, HomeLayout::serialNr.length);
+        columns.action[i] = getNumber(data, HomeLayout::action);
+        columns.relayId[i] = relayId;
+    }
+}
+
+void BatchDecoder::decodeMulti(const std::string_view *packets, size_t count, MultiColumns &columns) {
+    columns.resize(count);
+    for (size_t i = 0; i < count; i++) {
+        auto data = packets[i];
+        if (data.size() != MultiLayout::size) {
+            columns.error[i] = ParseError::lengthMismatch;
+            continue;
+        }
+        //Only five bytes of a MULTI packet have to be digits, classifying all 37 with SIMD is slower than visiting them.
+        //The scalar classifier only reads these positions, so the packet is not copied into a padded block either.
+        uint64_t digits;
+        uint64_t separators;
+        classifyScalar((const uint8_t *)data.data(), MultiLayout::size, multiDigits, digits, separators);
+
+        //MULTI has no separators, its fields are padded with "-"
+        int32_t userState = getCode(dashCodes, data, MultiLayout::userState);
+        int32_t fingerId = getCode(fingerCodes, data, MultiLayout::fingerId);
+        int32_t keyId = getCode(dashCodes, data, MultiLayout::keyId);
+        int32_t action = getCode(hexCodes, data, MultiLayout::action);
+        int32_t inputId = getCode(dashCodes, data, MultiLayout::inputId);
+        bool validDigits = ((digits & multiDigits) == multiDigits) & (userState != invalidCode) & (fingerId != invalidCode) & (keyId != invalidCode) &
+                           (action != invalidCode) & (inputId != invalidCode);
+        columns.error[i] = validDigits ? ParseError::none : ParseError::badDigit;
+
+        columns.packetType[i] = getNumber(data, MultiLayout::packetType);
+        columns.userId[i] = getNumber(data, MultiLayout::userId);
+        columns.userName[i] = data.substr(MultiLayout::userName.offset, MultiLayout::userName.length);
+        columns.userState[i] = userState;
+        columns.fingerId[i] = fingerId;
+        columns.keyId[i] = keyId;
+        columns.serialNr[i] = data.substr(MultiLayout::serialNr.offset, MultiLayout::serialNr.length);
+        columns.readerName[i] = data.substr(MultiLayout::readerName.offset, MultiLayout::readerName.length);
+        columns.action[i] = action;
+        columns.inputId[i] = inputId;
+    }
+}
+
+}
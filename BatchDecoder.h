@@ -0,0 +1,86 @@
+#ifndef EKEY_BATCHDECODER_H_
+#define EKEY_BATCHDECODER_H_
+
+#include "PacketParser.h"
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+namespace Ekey {
+
+enum class InstructionSet {
+    scalar,
+    sse2,
+    avx2
+};
+
+/**
+ * Decoded HOME packets of one batch, one vector per field. Row i belongs to the i-th packet of the batch, its other
+ * fields are only valid if error[i] is ParseError::none. String fields point into the packets. The vectors keep their
+ * capacity, so decoding batches of the same size does not allocate.
+ */
+struct HomeColumns {
+    std::vector<ParseError> error;
+    std::vector<int32_t> packetType;
+    std::vector<int32_t> userId;
+    std::vector<int32_t> fingerId;
+    std::vector<std::string_view> serialNr;
+    std::vector<int32_t> action;
+    std::vector<int32_t> relayId;
+
+    size_t size() const { return error.size(); }
+    void resize(size_t size);
+    HomePacket getPacket(size_t index) const;
+};
+
+/**
+ * Decoded MULTI packets of one batch, see HomeColumns.
+ */
+struct MultiColumns {
+    std::vector<ParseError> error;
+    std::vector<int32_t> packetType;
+    std::vector<int32_t> userId;
+    std::vector<std::string_view> userName;
+    std::vector<int32_t> userState;
+    std::vector<int32_t> fingerId;
+    std::vector<int32_t> keyId;
+    std::vector<std::string_view> serialNr;
+    std::vector<std::string_view> readerName;
+    std::vector<int32_t> action;
+    std::vector<int32_t> inputId;
+
+    size_t size() const { return error.size(); }
+    void resize(size_t size);
+    MultiPacket getPacket(size_t index) const;
+};
+
+/**
+ * Decodes many packets of one ASCII format at once. Every packet is classified with a single SIMD pass that yields a
+ * bit mask of its digit and separator positions, which is compared with the masks of the layout. The remaining single
+ * character fields are decoded through lookup tables, so a valid packet is decoded without branching on its content.
+ * The results and errors are the same as those of PacketParser::parseHome() and PacketParser::parseMulti().
+ *
+ * HOME packets are classified with AVX2 when the CPU supports it, SSE2 on any other x86 CPU and plain C++ everywhere
+ * else. MULTI packets only have five fixed digit positions besides the table decoded fields, so they are always checked
+ * in plain C++, which is faster for them than classifying the whole packet.
+ */
+class BatchDecoder {
+public:
+    static InstructionSet getInstructionSet();
+
+    /**
+     * Selects the instruction set for all following HOME batches, e. g. to compare them in a benchmark. Not thread safe
+     * with respect to running decodes.
+     *
+     * @return false if the CPU does not support the instruction set. The current one is kept then.
+     */
+    static bool setInstructionSet(InstructionSet instructionSet);
+    static std::string_view getInstructionSetName(InstructionSet instructionSet);
+
+    static void decodeHome(const std::string_view *packets, size_t count, HomeColumns &columns);
+    static void decodeMulti(const std::string_view *packets, size_t count, MultiColumns &columns);
+};
+
+}
+#endif
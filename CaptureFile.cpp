@@ -0,0 +1,152 @@
+#include "CaptureFile.h"
+
+#include <netinet/in.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+namespace Ekey {
+
+CaptureFile::~CaptureFile() {
+    close();
+}
+
+bool CaptureFile::create(const std::string &path, uint64_t size, std::string &error) {
+    close();
+    if (size < sizeof(Header) + sizeof(Record)) {
+        error = "Capture file size is too small.";
+        return false;
+    }
+    uint64_t capacity = (size - sizeof(Header)) / sizeof(Record);
+    size = sizeof(Header) + capacity * sizeof(Record);
+
+    _fileDescriptor = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0640);
+    if (_fileDescriptor == -1) {
+        error = "Could not open capture file " + path + ": " + std::string(strerror(errno));
+        return false;
+    }
+
+    struct stat fileInfo{};
+    if (fstat(_fileDescriptor, &fileInfo) == -1 || ((uint64_t)fileInfo.st_size != size && ftruncate(_fileDescriptor, (off_t)size) == -1)) {
+        error = "Could not resize capture file " + path + ": " + std::string(strerror(errno));
+        close();
+        return false;
+    }
+    bool reuse = (uint64_t)fileInfo.st_size == size;
+
+    if (!map(path, true, error)) return false;
+
+    if (!reuse || _header->magic != magic || _header->version != version || _header->recordSize != sizeof(Record) || _header->capacity != capacity) {
+        _header->magic = magic;
+        _header->version = version;
+        _header->recordSize = sizeof(Record);
+        _header->capacity = capacity;
+        _header->written.store(0, std::memory_order_relaxed);
+    }
+    return true;
+}
+
+bool CaptureFile::open(const std::string &path, std::string &error) {
+    close();
+    _fileDescriptor = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (_fileDescriptor == -1) {
+        error = "Could not open capture file " + path + ": " + std::string(strerror(errno));
+        return false;
+    }
+
+    if (!map(path, false, error)) return false;
+
+    if (_header->magic != magic || _header->version != version || _header->recordSize != sizeof(Record) || sizeof(Header) + _header->capacity * sizeof(Record) > _mappingSize) {
+        error = path + " is not a capture file of this version.";
+        close();
+        return false;
+    }
+    return true;
+}
+
+bool CaptureFile::map(const std::string &path, bool writable, std::string &error) {
+    struct stat fileInfo{};
+    if (fstat(_fileDescriptor, &fileInfo) == -1 || (size_t)fileInfo.st_size < sizeof(Header)) {
+        error = "Capture file " + path + " is too small.";
+        close();
+        return false;
+    }
+
+    _mappingSize = (size_t)fileInfo.st_size;
+    _mapping = mmap(nullptr, _mappingSize, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, _fileDescriptor, 0);
+    if (_mapping == MAP_FAILED) {
+        _mapping = nullptr;
+        error = "Could not map capture file " + path + ": " + std::string(strerror(errno));
+        close();
+        return false;
+    }
+    _header = (Header *)_mapping;
+    _records = (Record *)((uint8_t *)_mapping + sizeof(Header));
+    return true;
+}
+
+void CaptureFile::close() {
+    if (_mapping) munmap(_mapping, _mappingSize);
+    _mapping = nullptr;
+    _mappingSize = 0;
+    _header = nullptr;
+    _records = nullptr;
+    if (_fileDescriptor != -1) ::close(_fileDescriptor);
+    _fileDescriptor = -1;
+}
+
+void CaptureFile::append(std::string_view data, Protocol protocol, const SenderKey &sender, int64_t receiveTime) {
+    if (!_header) return;
+    uint64_t written = _header->written.load(std::memory_order_relaxed);
+    Record &record = _records[written % _header->capacity];
+    record.receiveTime = receiveTime;
+    record.size = (uint32_t)std::min(data.size(), Datagram::maxSize);
+    record.protocol = (uint8_t)protocol;
+    record.port = sender.port;
+    record.address.fill(0);
+    if (sender.isV4()) {
+        record.family = AF_INET;
+        std::memcpy(record.address.data(), sender.address.data() + 12, 4);
+    } else {
+        record.family = AF_INET6;
+        record.address = sender.address;
+    }
+    std::memcpy(record.data.data(), data.data(), record.size);
+    //Publish the record only after it is complete
+    _header->written.store(written + 1, std::memory_order_release);
+}
+
+uint64_t CaptureFile::count() const {
+    if (!_header) return 0;
+    uint64_t written = _header->written.load(std::memory_order_acquire);
+    return written < _header->capacity ? written : _header->capacity;
+}
+
+bool CaptureFile::read(uint64_t index, Datagram &datagram, int64_t &receiveTime) const {
+    if (!_header) return false;
+    uint64_t written = _header->written.load(std::memory_order_acquire);
+    uint64_t first = written > _header->capacity ? written - _header->capacity : 0;
+    if (first + index >= written) return false;
+
+    const Record &record = _records[(first + index) % _header->capacity];
+    receiveTime = record.receiveTime;
+    //Datagram sizes are limited to Datagram::maxSize, so only a damaged record can be longer
+    datagram.size = record.size < Datagram::maxSize ? record.size : (uint32_t)Datagram::maxSize;
+    datagram.protocol = (Protocol)record.protocol;
+    //The record keeps the address of the family it was received with, the datagram the IPv4-mapped form
+    datagram.sender.port = record.port;
+    if (record.family == AF_INET) {
+        sockaddr_storage sender{};
+        sender.ss_family = AF_INET;
+        std::memcpy(&((sockaddr_in &)sender).sin_addr, record.address.data(), 4);
+        datagram.sender.address = SenderKey::get(sender).address;
+    } else datagram.sender.address = record.address;
+    std::memcpy(datagram.data.data(), record.data.data(), datagram.size);
+    return true;
+}
+
+}
\ No newline at end of file
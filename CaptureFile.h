@@ -0,0 +1,74 @@
+#ifndef EKEY_CAPTUREFILE_H_
+#define EKEY_CAPTUREFILE_H_
+
+#include "DatagramRing.h"
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+namespace Ekey {
+
+/**
+ * Fixed size, memory mapped ring file of raw datagrams. Every record has the same size, so appending is a copy into the
+ * mapping and never allocates. Once the file is full the oldest records are overwritten. An existing capture with the
+ * same size is continued, so a redeploy does not erase it.
+ */
+class CaptureFile {
+public:
+    struct Record {
+        int64_t receiveTime; //Nanoseconds since the epoch
+        uint32_t size;
+        uint16_t port;
+        uint8_t family;
+        uint8_t protocol;
+        std::array<uint8_t, 16> address;
+        std::array<uint8_t, Datagram::maxSize> data;
+    };
+
+    CaptureFile() = default;
+    ~CaptureFile();
+    CaptureFile(const CaptureFile &) = delete;
+    CaptureFile &operator=(const CaptureFile &) = delete;
+
+    bool create(const std::string &path, uint64_t size, std::string &error);
+    bool open(const std::string &path, std::string &error);
+    void close();
+
+    /**
+     * Only one thread may append.
+     */
+    void append(std::string_view data, Protocol protocol, const SenderKey &sender, int64_t receiveTime);
+
+    /**
+     * @return The number of records in the file, at most the capacity.
+     */
+    uint64_t count() const;
+
+    /**
+     * @param index 0 is the oldest record.
+     */
+    bool read(uint64_t index, Datagram &datagram, int64_t &receiveTime) const;
+private:
+    struct Header {
+        std::array<char, 8> magic;
+        uint32_t version;
+        uint32_t recordSize;
+        uint64_t capacity;
+        std::atomic<uint64_t> written;
+    };
+
+    static constexpr std::array<char, 8> magic{'E', 'K', 'E', 'Y', 'C', 'A', 'P', '1'};
+    static constexpr uint32_t version = 1;
+
+    int _fileDescriptor = -1;
+    void *_mapping = nullptr;
+    size_t _mappingSize = 0;
+    Header *_header = nullptr;
+    Record *_records = nullptr;
+
+    bool map(const std::string &path, bool writable, std::string &error);
+};
+
+}
+#endif
\ No newline at end of file
@@ -0,0 +1,113 @@
+#ifndef EKEY_DATAGRAMRING_H_
+#define EKEY_DATAGRAMRING_H_
+
+#include "PacketParser.h"
+#include "SenderKey.h"
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+
+namespace Ekey {
+
+enum class OverflowPolicy {
+    dropOldest,
+    dropNewest,
+    block
+};
+
+/**
+ * A raw datagram as copied from the socket. Converter packets are at most 72 bytes long, longer datagrams are dropped
+ * before they are queued, so size never exceeds maxSize.
+ */
+struct Datagram {
+    static constexpr size_t maxSize = 256;
+
+    std::array<uint8_t, maxSize> data;
+    uint32_t size = 0;
+    Protocol protocol = Protocol::home;
+    SenderKey sender;
+    int64_t receiveTime = 0; //System clock when the kernel received the datagram (SO_TIMESTAMPNS), else when the listen thread read it
+
+    std::string_view view() const { return std::string_view((const char *)data.data(), size); }
+};
+
+/**
+ * Bounded lock-free ring between one receive thread (producer) and the dispatch thread (consumer). Every slot carries a
+ * sequence number, so besides the consumer the producer may also remove the oldest entry to make room for a new one.
+ * Entries are copied out on pop, a slot is never held while the consumer works on the datagram.
+ */
+class DatagramRing {
+public:
+    explicit DatagramRing(size_t capacity) {
+        //A single slot would carry the same sequence number when it is full and when it is free
+        size_t size = 2;
+        while (size < capacity) size <<= 1;
+        _mask = size - 1;
+        _slots.reset(new Slot[size]);
+        for (size_t i = 0; i < size; i++) {
+            _slots[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    size_t capacity() const { return _mask + 1; }
+
+    /**
+     * Producer only. Returns the next free slot or nullptr if the ring is full. The slot becomes visible to the consumer
+     * with commit().
+     */
+    Datagram *beginPush() {
+        size_t position = _head.load(std::memory_order_relaxed);
+        Slot &slot = _slots[position & _mask];
+        if (slot.sequence.load(std::memory_order_acquire) != position) return nullptr;
+        return &slot.datagram;
+    }
+
+    void commit() {
+        size_t position = _head.load(std::memory_order_relaxed);
+        _slots[position & _mask].sequence.store(position + 1, std::memory_order_release);
+        _head.store(position + 1, std::memory_order_relaxed);
+    }
+
+    /**
+     * Removes the oldest entry. Called by the consumer and, for OverflowPolicy::dropOldest, by the producer.
+     *
+     * @param datagram Receives a copy of the entry. Pass nullptr to discard it.
+     * @return false if the ring is empty.
+     */
+    bool pop(Datagram *datagram) {
+        size_t position = _tail.load(std::memory_order_relaxed);
+        while (true) {
+            Slot &slot = _slots[position & _mask];
+            size_t sequence = slot.sequence.load(std::memory_order_acquire);
+            auto difference = (intptr_t)sequence - (intptr_t)(position + 1);
+            if (difference == 0) {
+                if (_tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                    if (datagram) *datagram = slot.datagram;
+                    slot.sequence.store(position + _mask + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (difference < 0) return false;
+            else position = _tail.load(std::memory_order_relaxed);
+        }
+    }
+
+    bool empty() const {
+        size_t position = _tail.load(std::memory_order_relaxed);
+        return _slots[position & _mask].sequence.load(std::memory_order_acquire) != position + 1;
+    }
+private:
+    struct Slot {
+        std::atomic<size_t> sequence{0};
+        Datagram datagram;
+    };
+
+    std::unique_ptr<Slot[]> _slots;
+    size_t _mask = 0;
+    alignas(64) std::atomic<size_t> _head{0};
+    alignas(64) std::atomic<size_t> _tail{0};
+};
+
+}
+#endif
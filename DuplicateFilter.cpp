@@ -0,0 +1,72 @@
+#include "DuplicateFilter.h"
+
+#include <cstring>
+
+namespace Ekey {
+
+namespace {
+
+inline uint64_t mix(uint64_t value) {
+    //Finalizer of MurmurHash3
+    value ^= value >> 33;
+    value *= 0xff51afd7ed558ccdULL;
+    value ^= value >> 33;
+    value *= 0xc4ceb9fe1a85ec53ULL;
+    value ^= value >> 33;
+    return value;
+}
+
+inline uint64_t hashBytes(uint64_t hash, const void *data, size_t size) {
+    auto *bytes = (const uint8_t *)data;
+    while (size >= 8) {
+        uint64_t chunk;
+        std::memcpy(&chunk, bytes, 8);
+        hash = mix(hash ^ chunk);
+        bytes += 8;
+        size -= 8;
+    }
+    if (size > 0) {
+        uint64_t chunk = 0;
+        std::memcpy(&chunk, bytes, size);
+        hash = mix(hash ^ chunk ^ ((uint64_t)size << 56));
+    }
+    return hash;
+}
+
+}
+
+DuplicateFilter::DuplicateFilter(uint32_t capacity, int64_t window) : _window(window) {
+    uint32_t size = maxProbes;
+    while (size < capacity) size <<= 1;
+    _mask = size - 1;
+    _entries.reset(new Entry[size]);
+}
+
+uint64_t DuplicateFilter::hash(const SenderKey &sender, std::string_view packet, uint64_t seed) {
+    uint64_t result = mix(seed ^ packet.size() ^ ((uint64_t)sender.port << 32));
+    result = hashBytes(result, sender.address.data(), sender.address.size());
+    return hashBytes(result, packet.data(), packet.size());
+}
+
+bool DuplicateFilter::isDuplicate(const SenderKey &sender, std::string_view packet, int64_t now) {
+    uint64_t fingerprint = hash(sender, packet, 0x9e3779b97f4a7c15ULL);
+    uint64_t check = hash(sender, packet, 0x6a09e667f3bcc909ULL);
+
+    Entry *replace = nullptr;
+    for (uint32_t i = 0; i < maxProbes; i++) {
+        Entry &entry = _entries[(fingerprint + i) & _mask];
+        if (entry.expires <= now) {
+            if (!replace || replace->expires > now) replace = &entry;
+            continue;
+        }
+        if (entry.hash == fingerprint && entry.check == check) return true;
+        if (!replace || (replace->expires > now && entry.expires < replace->expires)) replace = &entry;
+    }
+
+    replace->hash = fingerprint;
+    replace->check = check;
+    replace->expires = now + _window;
+    return false;
+}
+
+}
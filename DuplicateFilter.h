@@ -0,0 +1,49 @@
+#ifndef EKEY_DUPLICATEFILTER_H_
+#define EKEY_DUPLICATEFILTER_H_
+
+#include "SenderKey.h"
+#include <cstdint>
+#include <memory>
+#include <string_view>
+
+namespace Ekey {
+
+/**
+ * Suppresses datagrams that were already received from the same sender within a time window. Entries are kept in a
+ * fixed size, open addressed table and identified by a 128 bit fingerprint of sender and packet bytes. A lookup probes
+ * at most maxProbes slots and never allocates. Expired entries are reused in place, so no tombstones are needed. When
+ * all probed slots are live, the entry that expires first is replaced.
+ */
+class DuplicateFilter {
+public:
+    /**
+     * @param capacity Number of entries, rounded up to a power of two.
+     * @param window Time window in nanoseconds.
+     */
+    DuplicateFilter(uint32_t capacity, int64_t window);
+
+    /**
+     * Returns true if the same packet was seen from the same sender within the window. Otherwise the packet is
+     * remembered and false is returned. The window starts with the first packet, repeats do not extend it.
+     *
+     * @param now Monotonic time in nanoseconds.
+     */
+    bool isDuplicate(const SenderKey &sender, std::string_view packet, int64_t now);
+private:
+    static constexpr uint32_t maxProbes = 8;
+
+    struct Entry {
+        uint64_t hash = 0;
+        uint64_t check = 0;
+        int64_t expires = 0; //0 marks a free slot
+    };
+
+    std::unique_ptr<Entry[]> _entries;
+    uint32_t _mask = 0;
+    int64_t _window = 0;
+
+    static uint64_t hash(const SenderKey &sender, std::string_view packet, uint64_t seed);
+};
+
+}
+#endif
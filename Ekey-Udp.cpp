@@ -6,8 +6,15 @@
 #include <arpa/inet.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <cstdio>
 #include <cstring>
 #include <netdb.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <algorithm>
+#include <random>
+#include <sstream>
 #include <homegear-node/JsonDecoder.h>
 #include <dialog.h>
 
@@ -22,13 +29,18 @@ Flows::NodeFactory *getFactory() {
 namespace Ekey {
 
 Ekey::Ekey(const std::string &path, const std::string &type, const std::atomic_bool *frontendConnected) : Flows::INode(path, type, frontendConnected) {
+    _stopEventDescriptor = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
 }
 
-Ekey::~Ekey() = default;
+Ekey::~Ekey() {
+    stopListenThreads();
+    if (_stopEventDescriptor != -1) close(_stopEventDescriptor);
+}
 
 bool Ekey::init(const Flows::PNodeInfo &info) {
     try {
         _nodeInfo = info;
+        _interned = &InternedValues::instance();
         return true;
     }
     catch (const std::exception &ex) {
@@ -39,37 +51,341 @@ bool Ekey::init(const Flows::PNodeInfo &info) {
 
 bool Ekey::start() {
     std::string listenAddress;
-    uint16_t port = 0;
+    std::string port;
+    std::string protocol;
 
     auto settingsIterator = _nodeInfo->info->structValue->find("listenaddress");
     if (settingsIterator != _nodeInfo->info->structValue->end()) listenAddress = settingsIterator->second->stringValue;
 
-    if (!listenAddress.empty() && !BaseLib::Net::isIp(listenAddress)) listenAddress = BaseLib::Net::getMyIpAddress(listenAddress);
-    else if (listenAddress.empty()) listenAddress = BaseLib::Net::getMyIpAddress();
-
     settingsIterator = _nodeInfo->info->structValue->find("listenport");
-    if (settingsIterator != _nodeInfo->info->structValue->end()) port = (uint16_t)Flows::Math::getUnsignedNumber(settingsIterator->second->stringValue);
+    if (settingsIterator != _nodeInfo->info->structValue->end()) port = settingsIterator->second->stringValue;
 
     settingsIterator = _nodeInfo->info->structValue->find("protocol");
-    if (settingsIterator != _nodeInfo->info->structValue->end()) _protocol = settingsIterator->second->stringValue;
+    if (settingsIterator != _nodeInfo->info->structValue->end()) protocol = settingsIterator->second->stringValue;
 
-    _stopListenThread = true;
-    if (_listenThread.joinable()) _listenThread.join();
+    std::vector<Endpoint> endpoints;
+    if (!port.empty()) {
+        Endpoint endpoint;
+        if (!getEndpoint(listenAddress, (uint16_t)Flows::Math::getUnsignedNumber(port), protocol, endpoint)) return false;
+        endpoints.push_back(std::move(endpoint));
+    }
+
+    settingsIterator = _nodeInfo->info->structValue->find("endpoints");
+    if (settingsIterator != _nodeInfo->info->structValue->end() && !getEndpoints(settingsIterator->second->stringValue, endpoints)) return false;
+
+    std::string replayFile;
+    settingsIterator = _nodeInfo->info->structValue->find("replayfile");
+    if (settingsIterator != _nodeInfo->info->structValue->end()) replayFile = settingsIterator->second->stringValue;
+
+    bool replayAtMaxSpeed = false;
+    settingsIterator = _nodeInfo->info->structValue->find("replayspeed");
+    if (settingsIterator != _nodeInfo->info->structValue->end()) replayAtMaxSpeed = settingsIterator->second->stringValue == "max";
+
+    if (endpoints.empty() && replayFile.empty()) {
+        _out->printError("Error: No listen port configured. Not starting listener.");
+        return false;
+    }
+
+    std::string captureFile;
+    settingsIterator = _nodeInfo->info->structValue->find("capturefile");
+    if (settingsIterator != _nodeInfo->info->structValue->end()) captureFile = settingsIterator->second->stringValue;
+
+    uint32_t captureSize = 16;
+    settingsIterator = _nodeInfo->info->structValue->find("capturesize");
+    if (settingsIterator != _nodeInfo->info->structValue->end()) captureSize = Flows::Math::getUnsignedNumber(settingsIterator->second->stringValue);
+
+    uint32_t workers = 1;
+    settingsIterator = _nodeInfo->info->structValue->find("workers");
+    if (settingsIterator != _nodeInfo->info->structValue->end()) workers = Flows::Math::getUnsignedNumber(settingsIterator->second->stringValue);
+    if (workers < 1) workers = 1;
+    else if (workers > maxWorkers) workers = maxWorkers;
+
+    uint32_t batchSize = 32;
+    settingsIterator = _nodeInfo->info->structValue->find("batchsize");
+    if (settingsIterator != _nodeInfo->info->structValue->end()) batchSize = Flows::Math::getUnsignedNumber(settingsIterator->second->stringValue);
+    if (batchSize < 1) batchSize = 1;
+    else if (batchSize > ReceiveBatch::maxSize) batchSize = ReceiveBatch::maxSize;
+
+    uint32_t batchTimeout = 0;
+    settingsIterator = _nodeInfo->info->structValue->find("batchtimeout");
+    if (settingsIterator != _nodeInfo->info->structValue->end()) batchTimeout = Flows::Math::getUnsignedNumber(settingsIterator->second->stringValue);
+
+    uint32_t receiveBuffer = 0;
+    settingsIterator = _nodeInfo->info->structValue->find("receivebuffer");
+    if (settingsIterator != _nodeInfo->info->structValue->end()) receiveBuffer = Flows::Math::getUnsignedNumber(settingsIterator->second->stringValue);
+    if (receiveBuffer > maxReceiveBuffer) receiveBuffer = maxReceiveBuffer;
+
+    uint32_t receiveBufferLimit = 0;
+    settingsIterator = _nodeInfo->info->structValue->find("receivebufferlimit");
+    if (settingsIterator != _nodeInfo->info->structValue->end()) receiveBufferLimit = Flows::Math::getUnsignedNumber(settingsIterator->second->stringValue);
+    if (receiveBufferLimit > maxReceiveBuffer) receiveBufferLimit = maxReceiveBuffer;
+
+    uint32_t queueSize = 1024;
+    settingsIterator = _nodeInfo->info->structValue->find("queuesize");
+    if (settingsIterator != _nodeInfo->info->structValue->end()) queueSize = Flows::Math::getUnsignedNumber(settingsIterator->second->stringValue);
+    if (queueSize < 1) queueSize = 1;
+    else if (queueSize > maxQueueSize) queueSize = maxQueueSize;
+
+    uint32_t metricsInterval = 60;
+    settingsIterator = _nodeInfo->info->structValue->find("metricsinterval");
+    if (settingsIterator != _nodeInfo->info->structValue->end()) metricsInterval = Flows::Math::getUnsignedNumber(settingsIterator->second->stringValue);
+
+    uint32_t duplicateWindow = 0;
+    settingsIterator = _nodeInfo->info->structValue->find("duplicatewindow");
+    if (settingsIterator != _nodeInfo->info->structValue->end()) duplicateWindow = Flows::Math::getUnsignedNumber(settingsIterator->second->stringValue);
+
+    uint32_t duplicateTableSize = 4096;
+    settingsIterator = _nodeInfo->info->structValue->find("duplicatetablesize");
+    if (settingsIterator != _nodeInfo->info->structValue->end()) duplicateTableSize = Flows::Math::getUnsignedNumber(settingsIterator->second->stringValue);
+    if (duplicateTableSize > maxDuplicateTableSize) duplicateTableSize = maxDuplicateTableSize;
+
+    PayloadType payloadType = PayloadType::full;
+    settingsIterator = _nodeInfo->info->structValue->find("payloadtype");
+    if (settingsIterator != _nodeInfo->info->structValue->end()) {
+        auto &type = settingsIterator->second->stringValue;
+        if (type == "compact") payloadType = PayloadType::compact;
+        else if (type == "raw") payloadType = PayloadType::raw;
+        else if (!type.empty() && type != "full") _out->printWarning("Warning: Unknown payload type \"" + type + "\". Outputting full events.");
+    }
+
+    uint32_t outputBatchSize = 1;
+    settingsIterator = _nodeInfo->info->structValue->find("outputbatchsize");
+    if (settingsIterator != _nodeInfo->info->structValue->end()) outputBatchSize = Flows::Math::getUnsignedNumber(settingsIterator->second->stringValue);
+    if (outputBatchSize < 1) outputBatchSize = 1;
+    else if (outputBatchSize > maxOutputBatchSize) outputBatchSize = maxOutputBatchSize;
+
+    uint32_t outputBatchTimeout = 100;
+    settingsIterator = _nodeInfo->info->structValue->find("outputbatchtimeout");
+    if (settingsIterator != _nodeInfo->info->structValue->end()) outputBatchTimeout = Flows::Math::getUnsignedNumber(settingsIterator->second->stringValue);
+
+    AllowList allowList;
+    settingsIterator = _nodeInfo->info->structValue->find("allowedsenders");
+    if (settingsIterator != _nodeInfo->info->structValue->end()) {
+        std::string error;
+        if (!allowList.parse(settingsIterator->second->stringValue, error)) {
+            _out->printError("Error: " + error + " Not starting listener.");
+            return false;
+        }
+    }
+
+    uint32_t rateLimit = 0;
+    settingsIterator = _nodeInfo->info->structValue->find("ratelimit");
+    if (settingsIterator != _nodeInfo->info->structValue->end()) rateLimit = Flows::Math::getUnsignedNumber(settingsIterator->second->stringValue);
+
+    uint32_t rateBurst = 10;
+    settingsIterator = _nodeInfo->info->structValue->find("rateburst");
+    if (settingsIterator != _nodeInfo->info->structValue->end()) rateBurst = Flows::Math::getUnsignedNumber(settingsIterator->second->stringValue);
+    if (rateBurst < 1) rateBurst = 1;
+
+    uint32_t refusalThreshold = 0;
+    settingsIterator = _nodeInfo->info->structValue->find("refusalthreshold");
+    if (settingsIterator != _nodeInfo->info->structValue->end()) refusalThreshold = Flows::Math::getUnsignedNumber(settingsIterator->second->stringValue);
+    if (refusalThreshold > maxRefusalThreshold) refusalThreshold = maxRefusalThreshold;
+
+    uint32_t refusalWindow = 60;
+    settingsIterator = _nodeInfo->info->structValue->find("refusalwindow");
+    if (settingsIterator != _nodeInfo->info->structValue->end()) refusalWindow = Flows::Math::getUnsignedNumber(settingsIterator->second->stringValue);
+    if (refusalWindow < 1) refusalWindow = 1;
+
+    bool suppressRefusals = false;
+    settingsIterator = _nodeInfo->info->structValue->find("refusalevents");
+    if (settingsIterator != _nodeInfo->info->structValue->end()) {
+        auto &events = settingsIterator->second->stringValue;
+        if (events == "suppress") suppressRefusals = true;
+        else if (!events.empty() && events != "output") _out->printWarning("Warning: Unknown refusal event setting \"" + events + "\". Outputting refusals.");
+    }
+
+    OverflowPolicy overflowPolicy = OverflowPolicy::dropOldest;
+    settingsIterator = _nodeInfo->info->structValue->find("overflowpolicy");
+    if (settingsIterator != _nodeInfo->info->structValue->end()) {
+        auto &policy = settingsIterator->second->stringValue;
+        if (policy == "dropnewest") overflowPolicy = OverflowPolicy::dropNewest;
+        else if (policy == "block") overflowPolicy = OverflowPolicy::block;
+        else if (!policy.empty() && policy != "dropoldest") _out->printWarning("Warning: Unknown overflow policy \"" + policy + "\". Dropping oldest datagrams.");
+    }
+
+    //The listen threads read the settings without locking, so they may only be replaced while no thread is running
+    stopListenThreads();
+    _endpoints = std::move(endpoints);
+    _workers = workers;
+    _batchSize = batchSize;
+    _batchTimeout = batchTimeout;
+    _receiveBuffer = receiveBuffer;
+    _receiveBufferLimit = receiveBufferLimit;
+    _queueSize = queueSize;
+    _overflowPolicy = overflowPolicy;
+    _metricsInterval = metricsInterval;
+    _duplicateWindow = duplicateWindow;
+    _duplicateTableSize = duplicateTableSize;
+    _outputBatchSize = outputBatchSize;
+    _outputBatchTimeout = outputBatchTimeout;
+    _outputBatch.reset();
+    _outputBatchReceiveTimes.clear();
+    _allowList = std::move(allowList);
+    _rateLimit = rateLimit;
+    _rateBurst = rateBurst;
+    _senderIpCache.clear();
+    _refusalCounter.reset();
+    if (refusalThreshold > 0) _refusalCounter = std::make_unique<RefusalCounter>(refusalTableSize, refusalThreshold, (int64_t)refusalWindow * 1000000000);
+    _refusalWindow = refusalWindow;
+    _suppressRefusals = suppressRefusals && _refusalCounter;
     _stopListenThread = false;
-    _listenThread = std::thread(&Ekey::listen, this, listenAddress, port, PayloadType::hex);
+    _stopDispatchThread = false;
+    if (_stopEventDescriptor == -1) {
+        _out->printError("Error: Could not create stop event: " + std::string(strerror(errno)));
+        return false;
+    }
+    uint64_t stopEvents = 0;
+    if (read(_stopEventDescriptor, &stopEvents, sizeof(stopEvents)) == -1 && errno != EAGAIN) {
+        _out->printError("Error: Could not reset stop event: " + std::string(strerror(errno)));
+    }
+    _metrics.reset();
+    _payloadType = payloadType;
+    closeUnusedSockets(replayFile.empty());
+
+    //Only build the hex dumps of received packets when they are actually logged
+    updateLogLevel();
+
+    _capture.reset();
+    if (!captureFile.empty() && replayFile.empty()) {
+        std::string error;
+        auto capture = std::make_unique<CaptureFile>();
+        if (capture->create(captureFile, (uint64_t)captureSize * 1024 * 1024, error)) _capture = std::move(capture);
+        else _out->printError("Error: " + error + " Not capturing datagrams.");
+    }
+
+    //In replay mode a single replay thread takes the place of the listen threads
+    uint32_t producers = replayFile.empty() ? _workers : 1;
+    _rings.clear();
+    for (uint32_t i = 0; i < producers; i++) {
+        _rings.emplace_back(std::make_unique<DatagramRing>(_queueSize));
+    }
+    _dispatchThread = std::thread(&Ekey::dispatch, this);
+    if (!replayFile.empty()) _listenThreads.emplace_back(&Ekey::replay, this, replayFile, replayAtMaxSpeed);
+    else {
+        _listenThreads.reserve(_workers);
+        for (uint32_t i = 0; i < _workers; i++) {
+            _listenThreads.emplace_back(&Ekey::listen, this, i);
+        }
+    }
 
     return true;
 }
 
 void Ekey::stop() {
-    _stopListenThread = true;
+    signalStop();
 }
 
 void Ekey::waitForStop() {
-    if (_listenThread.joinable()) _listenThread.join();
+    stopListenThreads();
+}
+
+SocketStore::Key Ekey::getSocketKey(const Endpoint &endpoint, uint32_t worker) {
+    return SocketStore::Key{_nodeInfo->id, endpoint.address, endpoint.port, worker, _workers > 1};
+}
+
+void Ekey::closeUnusedSockets(bool listening) {
+    //The previous instance of this node parked its sockets on exit. Sockets that are not taken over have to be closed
+    //before the new threads bind, otherwise their bind would fail.
+    bool reusePort = _workers > 1;
+    SocketStore::instance().closeUnused(_nodeInfo->id, [&](const SocketStore::Key &key) {
+        if (!listening || key.worker >= _workers || key.reusePort != reusePort) return false;
+        for (auto &endpoint : _endpoints) {
+            if (endpoint.address == key.address && endpoint.port == key.port) return true;
+        }
+        return false;
+    });
+}
+
+void Ekey::signalStop() {
+    _stopListenThread = true;
+    //The event is never read by the listen threads, so it stays readable and wakes all of them
+    uint64_t stopEvent = 1;
+    if (_stopEventDescriptor != -1 && write(_stopEventDescriptor, &stopEvent, sizeof(stopEvent)) == -1 && errno != EAGAIN) {
+        _out->printError("Error: Could not signal stop event: " + std::string(strerror(errno)));
+    }
+    wakeProducers();
+}
+
+bool Ekey::waitForStopEvent(std::chrono::nanoseconds timeout) {
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    while (!_stopListenThread) {
+        auto remaining = std::chrono::duration_cast<std::chrono::nanoseconds>(deadline - std::chrono::steady_clock::now()).count();
+        if (remaining <= 0) return false;
+        pollfd pollInfo{_stopEventDescriptor, POLLIN, 0};
+        timespec time{(time_t)(remaining / 1000000000), (long)(remaining % 1000000000)};
+        ppoll(&pollInfo, 1, &time, nullptr);
+    }
+    return true;
+}
+
+void Ekey::stopListenThreads() {
+    //The listen threads park their sockets in the SocketStore while they exit
+    signalStop();
+    bool wasRunning = !_listenThreads.empty();
+    for (auto &thread : _listenThreads) {
+        if (thread.joinable()) thread.join();
+    }
+    _listenThreads.clear();
+    if (!wasRunning) return;
+
+    //The dispatch thread drains the rings before it exits
+    _stopDispatchThread = true;
+    {
+        std::lock_guard<std::mutex> dispatchGuard(_dispatchMutex);
+        _dispatchConditionVariable.notify_one();
+    }
+    if (_dispatchThread.joinable()) _dispatchThread.join();
+
+    uint64_t batches = _metrics.sum(&WorkerMetrics::receivedBatches);
+    uint64_t datagrams = _metrics.sum(&WorkerMetrics::receivedDatagrams);
+    _out->printInfo("Info: Received " + std::to_string(datagrams) + " datagrams in " + std::to_string(batches) + " batches (average batch depth " + std::to_string(batches > 0 ? (double)datagrams / batches : 0.0) + ").");
+    _out->printInfo("Info: Enqueued " + std::to_string(_metrics.sum(&WorkerMetrics::enqueuedDatagrams)) + ", dispatched " + std::to_string(_metrics.dispatchedDatagrams) + " and dropped " + std::to_string(_metrics.sum(&WorkerMetrics::queueOverflows)) + " datagrams.");
+    if (_duplicateWindow > 0) _out->printInfo("Info: Suppressed " + std::to_string(_metrics.sum(&WorkerMetrics::duplicates)) + " duplicate datagrams.");
+}
+
+bool Ekey::getEndpoint(std::string address, uint16_t port, const std::string &protocol, Endpoint &endpoint) {
+    Protocol endpointProtocol = Protocol::home;
+    if (!PacketParser::getProtocol(protocol, endpointProtocol)) {
+        _out->printError("Error: Unknown protocol \"" + protocol + "\" for port " + std::to_string(port) + ". Not starting listener.");
+        return false;
+    }
+    endpoint.protocol = endpointProtocol;
+
+    //"::" or "*" listens on all addresses of both families with a single dual-stack socket
+    if (address == "*") address = anyAddress;
+    if (address.empty()) address = BaseLib::Net::getMyIpAddress();
+    else if (address != anyAddress && !BaseLib::Net::isIp(address)) address = BaseLib::Net::getMyIpAddress(address);
+
+    endpoint.address = std::move(address);
+    endpoint.port = port;
+    return true;
 }
 
-int Ekey::getSocketDescriptor(const std::string &listenAddress, uint16_t port) {
+bool Ekey::getEndpoints(const std::string &setting, std::vector<Endpoint> &endpoints) {
+    //One endpoint per line: "[address] port protocol"
+    std::istringstream lines(setting);
+    std::string line;
+    while (std::getline(lines, line)) {
+        std::istringstream fieldStream(line);
+        std::vector<std::string> fields;
+        std::string field;
+        while (fieldStream >> field) fields.push_back(field);
+        if (fields.empty()) continue;
+        if (fields.size() == 2) fields.insert(fields.begin(), std::string());
+        if (fields.size() != 3 || !Flows::Math::isNumber(fields.at(1))) {
+            _out->printError("Error: Invalid endpoint \"" + line + "\". Expected \"[address] port protocol\". Not starting listener.");
+            return false;
+        }
+
+        Endpoint endpoint;
+        if (!getEndpoint(fields.at(0), (uint16_t)Flows::Math::getUnsignedNumber(fields.at(1)), fields.at(2), endpoint)) return false;
+        endpoints.push_back(std::move(endpoint));
+    }
+    return true;
+}
+
+int Ekey::getSocketDescriptor(const std::string &listenAddress, uint16_t port, bool reusePort) {
     struct addrinfo *serverInfo = nullptr;
     int socketDescriptor = -1;
     try {
@@ -84,164 +400,894 @@ int Ekey::getSocketDescriptor(const std::string &listenAddress, uint16_t port) {
             return -1;
         }
 
-        socketDescriptor = socket(serverInfo->ai_family, SOCK_DGRAM, 0);
+        socketDescriptor = socket(serverInfo->ai_family, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
         if (socketDescriptor == -1) {
+            int error = errno;
+            freeaddrinfo(serverInfo);
+            if (error == EAFNOSUPPORT && listenAddress == anyAddress) {
+                _out->printWarning("Warning: IPv6 is not available. Listening on IPv4 only.");
+                return getSocketDescriptor("0.0.0.0", port, reusePort);
+            }
             _out->printError("Error: Could not create socket.");
+            return -1;
+        }
+
+        int32_t optionValue = 1;
+        if (reusePort && setsockopt(socketDescriptor, SOL_SOCKET, SO_REUSEPORT, &optionValue, sizeof(optionValue)) == -1) {
             freeaddrinfo(serverInfo);
+            serverInfo = nullptr;
+            close(socketDescriptor);
+            _out->printError("Error: Could not set SO_REUSEPORT: " + std::string(strerror(errno)));
             return -1;
         }
 
-        if (!(fcntl(socketDescriptor, F_GETFL) & O_NONBLOCK)) {
-            if (fcntl(socketDescriptor, F_SETFL, fcntl(socketDescriptor, F_GETFL) | O_NONBLOCK) < 0) {
-                freeaddrinfo(serverInfo);
-                serverInfo = nullptr;
-                close(socketDescriptor);
-                _out->printError("Error: Could not set non blocking mode.");
-                return -1;
-            }
+        //An IPv6 socket bound to the wildcard address also receives IPv4 datagrams from IPv4-mapped addresses
+        optionValue = 0;
+        if (serverInfo->ai_family == AF_INET6 && setsockopt(socketDescriptor, IPPROTO_IPV6, IPV6_V6ONLY, &optionValue, sizeof(optionValue)) == -1) {
+            _out->printWarning("Warning: Could not disable IPV6_V6ONLY: " + std::string(strerror(errno)));
+        }
+
+        //The kernel attaches its receive time to every datagram, so queueing before the listen thread becomes visible
+        optionValue = 1;
+        if (setsockopt(socketDescriptor, SOL_SOCKET, SO_TIMESTAMPNS, &optionValue, sizeof(optionValue)) == -1) {
+            _out->printWarning("Warning: Could not enable SO_TIMESTAMPNS: " + std::string(strerror(errno)) + ". Using the time of reception by the node instead.");
+        }
+
+        //Datagrams dropped because the receive buffer was full are otherwise invisible to the node
+        if (setsockopt(socketDescriptor, SOL_SOCKET, SO_RXQ_OVFL, &optionValue, sizeof(optionValue)) == -1) {
+            _out->printWarning("Warning: Could not enable SO_RXQ_OVFL: " + std::string(strerror(errno)) + ". Kernel drops are not counted.");
+        }
+
+        if (bind(socketDescriptor, serverInfo->ai_addr, serverInfo->ai_addrlen) == -1) {
+            _out->printError("Error: Binding to address " + listenAddress + " failed: " + std::string(strerror(errno)));
+            close(socketDescriptor);
+            freeaddrinfo(serverInfo);
+            return -1;
+        }
+        freeaddrinfo(serverInfo);
+        serverInfo = nullptr;
+
+        sockaddr_storage localAddress{};
+        socklen_t localAddressSize = sizeof(localAddress);
+        if (getsockname(socketDescriptor, (struct sockaddr *)&localAddress, &localAddressSize) == -1) {
+            close(socketDescriptor);
+            _out->printError("Error: Could not get listen IP and/or port.");
+            return -1;
+        }
+        auto localKey = SenderKey::get(localAddress);
+        std::string localIp = localKey.getAddressString();
+        if (localAddress.ss_family == AF_INET6 && localIp == anyAddress) localIp += " (IPv4 and IPv6)";
+        _out->printInfo("Info: Now listening on IP " + localIp + " and port " + std::to_string(localKey.port) + ".");
+        return socketDescriptor;
+    }
+    catch (const std::exception &ex) {
+        _out->printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+    }
+    if (socketDescriptor != -1) close(socketDescriptor);
+    freeaddrinfo(serverInfo);
+    return -1;
+}
+
+Ekey::ReceiveBatch::ReceiveBatch(uint32_t size) : buffers(size), senders(size), controls(size), iovecs(size), headers(size) {
+    for (uint32_t i = 0; i < size; i++) {
+        iovecs[i].iov_base = buffers[i].data();
+        iovecs[i].iov_len = bufferSize;
+        headers[i].msg_hdr.msg_iov = &iovecs[i];
+        headers[i].msg_hdr.msg_iovlen = 1;
+        headers[i].msg_hdr.msg_name = &senders[i];
+    }
+}
+
+void Ekey::ReceiveBatch::prepare(uint32_t offset) {
+    //recvmmsg overwrites the address and control lengths and flags of every filled slot, so they need to be reset before reuse
+    for (uint32_t i = offset; i < headers.size(); i++) {
+        headers[i].msg_hdr.msg_namelen = sizeof(sockaddr_storage);
+        headers[i].msg_hdr.msg_control = controls[i].data.data();
+        headers[i].msg_hdr.msg_controllen = controlSize;
+        headers[i].msg_hdr.msg_flags = 0;
+        headers[i].msg_len = 0;
+    }
+}
+
+void Ekey::ReceiveBatch::getControlData(uint32_t index, int64_t &kernelTime, uint32_t &dropCount) {
+    kernelTime = 0;
+    auto &header = headers[index].msg_hdr;
+    for (cmsghdr *control = CMSG_FIRSTHDR(&header); control; control = CMSG_NXTHDR(&header, control)) {
+        if (control->cmsg_level != SOL_SOCKET) continue;
+        if (control->cmsg_type == SCM_TIMESTAMPNS) {
+            timespec time{};
+            std::memcpy(&time, CMSG_DATA(control), sizeof(time));
+            kernelTime = (int64_t)time.tv_sec * 1000000000 + time.tv_nsec;
+        } else if (control->cmsg_type == SO_RXQ_OVFL) std::memcpy(&dropCount, CMSG_DATA(control), sizeof(dropCount));
+    }
+}
+
+uint32_t Ekey::setReceiveBuffer(int socketDescriptor, uint32_t size) {
+    //SO_RCVBUFFORCE ignores net.core.rmem_max but needs CAP_NET_ADMIN
+    int32_t optionValue = (int32_t)size;
+    if (size > 0 && setsockopt(socketDescriptor, SOL_SOCKET, SO_RCVBUFFORCE, &optionValue, sizeof(optionValue)) == -1 &&
+        setsockopt(socketDescriptor, SOL_SOCKET, SO_RCVBUF, &optionValue, sizeof(optionValue)) == -1) {
+        _out->printWarning("Warning: Could not set receive buffer size: " + std::string(strerror(errno)));
+    }
+
+    //The kernel reserves twice the requested size for its bookkeeping and reports the doubled value
+    optionValue = 0;
+    socklen_t optionSize = sizeof(optionValue);
+    if (getsockopt(socketDescriptor, SOL_SOCKET, SO_RCVBUF, &optionValue, &optionSize) == -1) return size;
+    uint32_t result = (uint32_t)optionValue / 2;
+    if (result < size) _out->printWarning("Warning: Receive buffer size is limited to " + std::to_string(result / 1024) + " KiB. Raise net.core.rmem_max to allow more.");
+    return result;
+}
+
+void Ekey::growReceiveBuffer(Listener &listener) {
+    uint32_t limit = _receiveBufferLimit * 1024;
+    if (listener.receiveBuffer >= limit) return;
+    uint32_t receiveBuffer = setReceiveBuffer(listener.socketDescriptor, std::min(limit, listener.receiveBuffer * 2));
+    //Stop trying once the kernel does not grant more
+    listener.receiveBuffer = receiveBuffer > listener.receiveBuffer ? receiveBuffer : limit;
+    _out->printInfo("Info: Kernel dropped datagrams on port " + std::to_string(listener.endpoint->port) + ". Receive buffer is now " + std::to_string(receiveBuffer / 1024) + " KiB.");
+}
+
+int32_t Ekey::receiveBatch(int socketDescriptor, ReceiveBatch &batch, int &error) {
+    uint32_t count = 0;
+    error = 0;
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(_batchTimeout);
+    while (count < batch.headers.size()) {
+        batch.prepare(count);
+        int result = recvmmsg(socketDescriptor, batch.headers.data() + count, batch.headers.size() - count, MSG_DONTWAIT, nullptr);
+        if (result > 0) {
+            count += result;
+            continue;
+        }
+        if (result < 0 && errno == EINTR) continue;
+        if (result < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+            //Only a broken descriptor makes the socket unusable. Anything else, e. g. a pending ICMP error or a lack of
+            //memory, is reported once and the socket stays bound.
+            if (errno == EBADF || errno == ENOTSOCK || errno == EFAULT || errno == EINVAL) return count > 0 ? (int32_t)count : -1;
+            error = errno;
+            if (_logLevel >= 4) _out->printMessage("Receive error: " + std::string(strerror(errno)), 4);
+            break;
         }
 
-        if (serverInfo->ai_family == AF_INET) {
-            struct sockaddr_in localSock{};
-            localSock.sin_family = serverInfo->ai_family;
-            localSock.sin_port = htons(port);
-            localSock.sin_addr.s_addr = ((struct sockaddr_in *)serverInfo->ai_addr)->sin_addr.s_addr;
+        //The socket is drained. Wait for stragglers until the batch timeout expires, but only once the batch has been started.
+        if (_batchTimeout == 0 || count == 0) break;
+        auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+        if (remaining <= 0) break;
+        pollfd pollInfo{socketDescriptor, POLLIN, 0};
+        if (poll(&pollInfo, 1, (int)remaining) <= 0) break;
+    }
+    return count;
+}
 
-            if (bind(socketDescriptor, (struct sockaddr *)&localSock, sizeof(localSock)) == -1) {
-                _out->printError("Error: Binding to address " + listenAddress + " failed: " + std::string(strerror(errno)));
-                close(socketDescriptor);
-                freeaddrinfo(serverInfo);
+void Ekey::listen(uint32_t worker) {
+    int epollDescriptor = -1;
+    std::vector<Listener> listeners;
+    try {
+        //Listeners are registered in epoll by address, so the vector must not reallocate after this point
+        listeners.resize(_endpoints.size());
+        for (size_t i = 0; i < _endpoints.size(); i++) {
+            listeners[i].endpoint = &_endpoints[i];
+        }
+
+        auto &ring = *_rings.at(worker);
+        auto &metrics = _metrics.getWorker(worker);
+
+        ReceiveBatch batch(_batchSize);
+
+        //SO_REUSEPORT hashes the sender's address and port, so all datagrams of one sender arrive at the same worker
+        //and every worker can keep its own table.
+        std::unique_ptr<DuplicateFilter> duplicateFilter;
+        if (_duplicateWindow > 0) duplicateFilter = std::make_unique<DuplicateFilter>(_duplicateTableSize, (int64_t)_duplicateWindow * 1000000);
+        std::unique_ptr<RateLimiter> rateLimiter;
+        if (_rateLimit > 0) rateLimiter = std::make_unique<RateLimiter>(maxRateLimitedSenders, _rateLimit, _rateBurst);
+        //stop() wakes the loop through the stop event, it is registered without a listener
+        auto createEpoll = [&]() {
+            int descriptor = epoll_create1(EPOLL_CLOEXEC);
+            if (descriptor == -1) {
+                _out->printError("Error: Could not create epoll instance for worker " + std::to_string(worker) + ": " + std::string(strerror(errno)));
                 return -1;
             }
-
-            uint32_t localSockSize = sizeof(localSock);
-            if (getsockname(socketDescriptor, (struct sockaddr *)&localSock, &localSockSize) == -1) {
-                freeaddrinfo(serverInfo);
-                serverInfo = nullptr;
-                close(socketDescriptor);
-                _out->printError("Error: Could not get listen IP and/or port.");
+            epoll_event stopEvent{};
+            stopEvent.events = EPOLLIN;
+            stopEvent.data.ptr = nullptr;
+            if (epoll_ctl(descriptor, EPOLL_CTL_ADD, _stopEventDescriptor, &stopEvent) == -1) {
+                _out->printError("Error: Could not add stop event to epoll: " + std::string(strerror(errno)));
+                close(descriptor);
                 return -1;
             }
+            return descriptor;
+        };
+        epollDescriptor = createEpoll();
+        if (epollDescriptor == -1) return;
+
+        //Failed binds are retried with a jittered exponential backoff, so workers and nodes do not retry in lockstep
+        std::minstd_rand random(std::random_device{}() + worker);
+        auto scheduleRebind = [&](Listener &listener, std::chrono::steady_clock::time_point now) {
+            listener.rebindDelay = listener.rebindDelay.count() == 0 ? minRebindDelay : std::min(listener.rebindDelay * 2, maxRebindDelay);
+            std::uniform_int_distribution<int64_t> jitter(listener.rebindDelay.count() / 2, listener.rebindDelay.count());
+            listener.nextBindAttempt = now + std::chrono::milliseconds(jitter(random));
+        };
+
+        std::array<epoll_event, 64> events{};
+        std::chrono::milliseconds epollDelay{0};
+        while (!_stopListenThread) {
+            auto now = std::chrono::steady_clock::now();
+            auto nextBindAttempt = std::chrono::steady_clock::time_point::max();
+            for (auto &listener : listeners) {
+                if (listener.socketDescriptor != -1 && !listener.paused) continue;
+                if (now < listener.nextBindAttempt) {
+                    nextBindAttempt = std::min(nextBindAttempt, listener.nextBindAttempt);
+                    continue;
+                }
+
+                //A paused socket stays bound, it only has to be added to epoll again
+                if (listener.paused) listener.paused = false;
+                else {
+                    listener.dropCount = 0;
+                    listener.socketDescriptor = SocketStore::instance().take(getSocketKey(*listener.endpoint, worker), listener.dropCount);
+                    if (listener.socketDescriptor == -1) listener.socketDescriptor = getSocketDescriptor(listener.endpoint->address, listener.endpoint->port, _workers > 1);
+                    if (listener.socketDescriptor == -1) {
+                        Metrics::increment(metrics.socketErrors);
+                        scheduleRebind(listener, now);
+                        nextBindAttempt = std::min(nextBindAttempt, listener.nextBindAttempt);
+                        continue;
+                    }
+                    if (listener.wasBound) Metrics::increment(metrics.rebinds);
+                    listener.wasBound = true;
+                    //Also applied to sockets taken over, the setting may have changed with the restart
+                    listener.receiveBuffer = setReceiveBuffer(listener.socketDescriptor, _receiveBuffer * 1024);
+                }
+
+                epoll_event event{};
+                event.events = EPOLLIN;
+                event.data.ptr = &listener;
+                if (epoll_ctl(epollDescriptor, EPOLL_CTL_ADD, listener.socketDescriptor, &event) == -1) {
+                    _out->printError("Error: Could not add socket to epoll: " + std::string(strerror(errno)));
+                    close(listener.socketDescriptor);
+                    listener.socketDescriptor = -1;
+                    scheduleRebind(listener, now);
+                    nextBindAttempt = std::min(nextBindAttempt, listener.nextBindAttempt);
+                }
+            }
 
-            auto *s = (struct sockaddr_in *)&(localSock.sin_addr);
-            char ipStringBuffer[INET6_ADDRSTRLEN + 1];
-            inet_ntop(AF_INET, s, ipStringBuffer, sizeof(ipStringBuffer));
-            ipStringBuffer[INET6_ADDRSTRLEN] = '\0';
-            _out->printInfo("Info: Now listening on IP " + std::string(ipStringBuffer) + " and port " + portString + ".");
-        } else //AF_INET6
-        {
-            struct sockaddr_in6 localSock{};
-            localSock.sin6_family = serverInfo->ai_family;
-            localSock.sin6_port = htons(port);
-            localSock.sin6_addr = ((struct sockaddr_in6 *)serverInfo->ai_addr)->sin6_addr;
-
-            if (bind(socketDescriptor, (struct sockaddr *)&localSock, sizeof(localSock)) == -1) {
-                _out->printError("Error: Binding to address " + listenAddress + " failed: " + std::string(strerror(errno)));
-                close(socketDescriptor);
-                freeaddrinfo(serverInfo);
-                return -1;
+            //Without pending binds the thread only wakes up for datagrams or the stop event
+            int timeout = -1;
+            if (nextBindAttempt != std::chrono::steady_clock::time_point::max()) {
+                auto remaining = std::chrono::ceil<std::chrono::milliseconds>(nextBindAttempt - now).count();
+                timeout = (int)std::max((int64_t)0, (int64_t)remaining);
             }
 
-            uint32_t localSockSize = sizeof(localSock);
-            if (getsockname(socketDescriptor, (struct sockaddr *)&localSock, &localSockSize) == -1) {
-                freeaddrinfo(serverInfo);
-                serverInfo = nullptr;
-                close(socketDescriptor);
-                _out->printError("Error: Could not get listen IP and/or port.");
-                return -1;
+            int eventCount = epoll_wait(epollDescriptor, events.data(), events.size(), timeout);
+            if (eventCount == -1) {
+                if (errno == EINTR) continue;
+                //The thread must not end while the node is running. Rebuild the epoll set with the rebind backoff instead.
+                _out->printError("Error: epoll_wait failed for worker " + std::to_string(worker) + ": " + std::string(strerror(errno)));
+                Metrics::increment(metrics.socketErrors);
+                close(epollDescriptor);
+                epollDescriptor = -1;
+                //The sockets stay bound, they are added to the new epoll instance like paused sockets
+                for (auto &listener : listeners) {
+                    if (listener.socketDescriptor == -1 || listener.paused) continue;
+                    listener.paused = true;
+                    listener.nextBindAttempt = std::chrono::steady_clock::time_point();
+                }
+                while (epollDescriptor == -1) {
+                    epollDelay = epollDelay.count() == 0 ? minRebindDelay : std::min(epollDelay * 2, maxRebindDelay);
+                    if (waitForStopEvent(epollDelay)) break;
+                    epollDescriptor = createEpoll();
+                    if (epollDescriptor == -1) Metrics::increment(metrics.socketErrors);
+                }
+                continue;
+            }
+            epollDelay = std::chrono::milliseconds(0);
+
+            for (int i = 0; i < eventCount; i++) {
+                if (!events[i].data.ptr) continue;
+                auto &listener = *(Listener *)events[i].data.ptr;
+                int error = 0;
+                int32_t received = receiveBatch(listener.socketDescriptor, batch, error);
+                if (error != 0) Metrics::increment(metrics.receiveErrors);
+                if (received < 0) {
+                    Metrics::increment(metrics.socketErrors);
+                    //Closing the socket also removes it from epoll
+                    close(listener.socketDescriptor);
+                    listener.socketDescriptor = -1;
+                    scheduleRebind(listener, std::chrono::steady_clock::now());
+                    continue;
+                }
+                if (received == 0 && error != 0) {
+                    //epoll is level-triggered, so an error that keeps the socket readable would wake the thread again
+                    //immediately. Clear a pending error and pause the socket with the rebind backoff.
+                    int pendingError = 0;
+                    socklen_t pendingErrorSize = sizeof(pendingError);
+                    getsockopt(listener.socketDescriptor, SOL_SOCKET, SO_ERROR, &pendingError, &pendingErrorSize);
+                    epoll_ctl(epollDescriptor, EPOLL_CTL_DEL, listener.socketDescriptor, nullptr);
+                    listener.paused = true;
+                    scheduleRebind(listener, std::chrono::steady_clock::now());
+                    continue;
+                }
+                if (received == 0) continue;
+                //The backoff starts over once the socket delivers datagrams again
+                listener.rebindDelay = std::chrono::milliseconds(0);
+                Metrics::increment(metrics.receivedBatches);
+                Metrics::increment(metrics.receivedDatagrams, received);
+
+                uint32_t dropCount = listener.dropCount;
+                enqueueBatch(ring, metrics, listener, batch, received, duplicateFilter.get(), rateLimiter.get());
+                if (listener.dropCount != dropCount && _receiveBufferLimit > 0) growReceiveBuffer(listener);
+            }
+        }
+    }
+    catch (const std::exception &ex) {
+        _out->printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+    }
+
+    //node-blue destroys the node on a redeploy. The sockets stay bound, so the kernel keeps queueing datagrams until the
+    //next instance takes them over.
+    for (auto &listener : listeners) {
+        if (listener.socketDescriptor == -1) continue;
+        if (epollDescriptor != -1) epoll_ctl(epollDescriptor, EPOLL_CTL_DEL, listener.socketDescriptor, nullptr);
+        SocketStore::instance().park(getSocketKey(*listener.endpoint, worker), listener.socketDescriptor, listener.dropCount);
+    }
+    if (epollDescriptor != -1) close(epollDescriptor);
+}
+
+void Ekey::enqueueBatch(DatagramRing &ring, WorkerMetrics &metrics, Listener &listener, ReceiveBatch &batch, int32_t count, DuplicateFilter *duplicateFilter, RateLimiter *rateLimiter) {
+    //The filters work on the steady clock. Datagrams without kernel timestamp and the capture get the system clock, read
+    //once per batch, so steps of the system clock are followed like by the kernel timestamps.
+    int64_t steadyTime = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    int64_t systemTime = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    uint64_t receivedBytes = 0;
+    uint64_t enqueued = 0;
+    uint32_t dropCount = listener.dropCount;
+    for (int32_t i = 0; i < count; i++) {
+        auto &header = batch.headers[i];
+        int64_t kernelTime = 0;
+        batch.getControlData(i, kernelTime, dropCount);
+        //An empty datagram is valid UDP, it just does not contain a packet
+        if (header.msg_len == 0) continue;
+        receivedBytes += header.msg_len;
+        //Such a datagram cannot be a converter packet and would not fit into a ring slot
+        if (header.msg_len > Datagram::maxSize) {
+            Metrics::increment(metrics.oversizedDatagrams);
+            continue;
+        }
+        if (kernelTime != 0) metrics.socketLatency.record((uint64_t)std::max((int64_t)0, systemTime - kernelTime));
+        int64_t receiveTime = kernelTime != 0 ? kernelTime : systemTime;
+
+        auto sender = SenderKey::get(batch.senders[i]);
+        std::string_view packet((const char *)batch.buffers[i].data(), header.msg_len);
+        Protocol protocol = listener.endpoint->protocol;
+        //The capture holds the datagrams as the socket delivered them, so a replay runs them through the same filters
+        if (_capture) {
+            std::lock_guard<std::mutex> captureGuard(_captureMutex);
+            _capture->append(packet, protocol, sender, receiveTime);
+        }
+        if (!isAccepted(metrics, sender, packet, steadyTime, duplicateFilter, rateLimiter)) continue;
+
+        Datagram *datagram = ring.beginPush();
+        if (!datagram) {
+            if (_overflowPolicy == OverflowPolicy::dropNewest) {
+                Metrics::increment(metrics.queueOverflows);
+                continue;
             }
 
-            auto *s = (struct sockaddr_in6 *)&(localSock.sin6_addr);
-            char ipStringBuffer[INET6_ADDRSTRLEN + 1];
-            inet_ntop(AF_INET6, s, ipStringBuffer, sizeof(ipStringBuffer));
-            ipStringBuffer[INET6_ADDRSTRLEN] = '\0';
-            _out->printInfo("Info: Now listening on IP " + std::string(ipStringBuffer) + " and port " + portString + ".");
+            wakeDispatchThread();
+            if (_overflowPolicy == OverflowPolicy::dropOldest) {
+                while (!(datagram = ring.beginPush())) {
+                    if (ring.pop(nullptr)) Metrics::increment(metrics.queueOverflows);
+                }
+            } else datagram = waitForSpace(ring);
+            if (!datagram) break;
         }
 
-        freeaddrinfo(serverInfo);
-        return socketDescriptor;
+        std::memcpy(datagram->data.data(), packet.data(), packet.size());
+        datagram->size = header.msg_len;
+        datagram->protocol = protocol;
+        datagram->sender = sender;
+        datagram->receiveTime = receiveTime;
+        ring.commit();
+        enqueued++;
+    }
+    Metrics::increment(metrics.receivedBytes, receivedBytes);
+    Metrics::increment(metrics.enqueuedDatagrams, enqueued);
+    //The kernel reports a running total per socket, which wraps at 2^32
+    if (dropCount != listener.dropCount) {
+        Metrics::increment(metrics.kernelDrops, dropCount - listener.dropCount);
+        listener.dropCount = dropCount;
+    }
+    wakeDispatchThread();
+}
+
+bool Ekey::isAccepted(WorkerMetrics &metrics, const SenderKey &sender, std::string_view packet, int64_t time, DuplicateFilter *duplicateFilter, RateLimiter *rateLimiter) {
+    //Sender checks work on the binary key, nothing is formatted for rejected datagrams
+    if (!_allowList.empty() && !_allowList.isAllowed(sender)) {
+        Metrics::increment(metrics.rejectedSenders);
+        return false;
+    }
+
+    //Converters repeat packets, the repeats must not use up the sender's rate
+    if (duplicateFilter && duplicateFilter->isDuplicate(sender, packet, time)) {
+        Metrics::increment(metrics.duplicates);
+        return false;
+    }
+
+    if (rateLimiter && !rateLimiter->acquire(sender, time)) {
+        Metrics::increment(metrics.rateLimited);
+        return false;
+    }
+    return true;
+}
+
+void Ekey::replay(const std::string &path, bool maxSpeed) {
+    try {
+        CaptureFile capture;
+        std::string error;
+        if (!capture.open(path, error)) {
+            _out->printError("Error: " + error);
+            return;
+        }
+
+        auto &ring = *_rings.at(0);
+        auto &metrics = _metrics.getWorker(0);
+        uint64_t count = capture.count();
+
+        //The filters see the original receive times, so they drop the same datagrams at any replay speed
+        std::unique_ptr<DuplicateFilter> duplicateFilter;
+        if (_duplicateWindow > 0) duplicateFilter = std::make_unique<DuplicateFilter>(_duplicateTableSize, (int64_t)_duplicateWindow * 1000000);
+        std::unique_ptr<RateLimiter> rateLimiter;
+        if (_rateLimit > 0) rateLimiter = std::make_unique<RateLimiter>(maxRateLimitedSenders, _rateLimit, _rateBurst);
+        _out->printInfo("Info: Replaying " + std::to_string(count) + " datagrams from " + path + (maxSpeed ? " at maximum speed." : " at original speed."));
+
+        Datagram datagram;
+        int64_t receiveTime = 0;
+        int64_t firstReceiveTime = 0;
+        auto start = std::chrono::steady_clock::now();
+        uint64_t replayed = 0;
+        for (; replayed < count && !_stopListenThread; replayed++) {
+            if (!capture.read(replayed, datagram, receiveTime)) break;
+            if (replayed == 0) firstReceiveTime = receiveTime;
+
+            if (!maxSpeed) {
+                auto due = start + std::chrono::nanoseconds(receiveTime - firstReceiveTime);
+                if (waitForStopEvent(due - std::chrono::steady_clock::now())) break;
+            }
+            Metrics::increment(metrics.receivedDatagrams);
+            Metrics::increment(metrics.receivedBytes, datagram.size);
+            if (!isAccepted(metrics, datagram.sender, datagram.view(), receiveTime, duplicateFilter.get(), rateLimiter.get())) continue;
+
+            //A replay never drops datagrams, it waits for the dispatch thread instead
+            Datagram *slot = ring.beginPush();
+            if (!slot) {
+                wakeDispatchThread();
+                slot = waitForSpace(ring);
+            }
+            if (!slot) break;
+
+            *slot = datagram;
+            //The datagram counts as received now, its original receive time would distort the latencies
+            slot->receiveTime = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+            ring.commit();
+            Metrics::increment(metrics.enqueuedDatagrams);
+            wakeDispatchThread();
+        }
+        _out->printInfo("Info: Replayed " + std::to_string(replayed) + " of " + std::to_string(count) + " datagrams.");
     }
     catch (const std::exception &ex) {
         _out->printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
     }
-    close(socketDescriptor);
-    freeaddrinfo(serverInfo);
-    return -1;
 }
 
-void Ekey::listen(const std::string &listenAddress, uint16_t port, PayloadType payloadType) {
+void Ekey::updateLogLevel() {
+    //Without an answer the level stays as it is, 3 at first, so no hex dumps are built for nothing
+    auto logLevel = invoke("logLevel", std::make_shared<Flows::Array>());
+    if (logLevel && !logLevel->errorStruct && logLevel->type == Flows::VariableType::tInteger) _logLevel.store(logLevel->integerValue, std::memory_order_relaxed);
+}
+
+void Ekey::wakeDispatchThread() {
+    //Pairs with the fence in dispatch(): either the dispatch thread sees the new entries or we see that it is waiting
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!_dispatchWaiting.load(std::memory_order_relaxed)) return;
+    std::lock_guard<std::mutex> dispatchGuard(_dispatchMutex);
+    _dispatchConditionVariable.notify_one();
+}
+
+Datagram *Ekey::waitForSpace(DatagramRing &ring) {
+    //Pairs with the fence in wakeProducers(): either we see the free slot or the dispatch thread sees that we are waiting
+    Datagram *datagram = nullptr;
+    std::unique_lock<std::mutex> spaceGuard(_spaceMutex);
+    _spaceWaiters++;
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    _spaceConditionVariable.wait(spaceGuard, [&] { return (datagram = ring.beginPush()) || _stopListenThread; });
+    _spaceWaiters--;
+    return datagram;
+}
+
+void Ekey::wakeProducers() {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (_spaceWaiters.load(std::memory_order_relaxed) == 0) return;
+    std::lock_guard<std::mutex> spaceGuard(_spaceMutex);
+    _spaceConditionVariable.notify_all();
+}
+
+void Ekey::dispatch() {
     try {
-        int socketDescriptor = -1;
-        std::array<uint8_t, 4096> buffer{};
-        while (!_stopListenThread) {
-            if (socketDescriptor == -1) {
-                std::this_thread::sleep_for(std::chrono::milliseconds(1000));
-                socketDescriptor = getSocketDescriptor(listenAddress, port);
-                continue;
+        //Every round takes at most maxDispatchBatch entries from each ring, so one busy listen thread cannot starve the others
+        std::vector<Datagram> datagrams(maxDispatchBatch);
+        auto nextMetricsOutput = std::chrono::steady_clock::now() + std::chrono::seconds(_metricsInterval);
+        auto nextLogLevelUpdate = std::chrono::steady_clock::now() + logLevelInterval;
+        while (true) {
+            bool dispatched = false;
+            for (auto &ring : _rings) {
+                uint32_t count = 0;
+                while (count < maxDispatchBatch && ring->pop(&datagrams[count])) count++;
+                if (count == 0) continue;
+                processDatagrams(datagrams.data(), count);
+                Metrics::increment(_metrics.dispatchedDatagrams, count);
+                dispatched = true;
             }
+            if (dispatched) wakeProducers();
 
-            timeval timeout{};
-            timeout.tv_sec = 1;
-            timeout.tv_usec = 0;
-
-            int32_t nfds = socketDescriptor + 1;
-            fd_set readFileDescriptor;
-            FD_ZERO(&readFileDescriptor);
-            FD_SET(socketDescriptor, &readFileDescriptor);
+            auto now = std::chrono::steady_clock::now();
+            //The log level can change at runtime. It is only refreshed while datagrams arrive, an idle node does not wake up for it.
+            if (dispatched && now >= nextLogLevelUpdate) {
+                updateLogLevel();
+                nextLogLevelUpdate = now + logLevelInterval;
+            }
+            if (_outputBatch && now >= _outputBatchDeadline) flushOutputBatch();
+            if (_metricsInterval > 0 && now >= nextMetricsOutput) {
+                outputMetrics();
+                nextMetricsOutput = std::chrono::steady_clock::now() + std::chrono::seconds(_metricsInterval);
+            }
 
-            auto result = select(nfds, &readFileDescriptor, nullptr, nullptr, &timeout);
-            if (result == 0) continue;
-            else if (result != 1) {
-                close(socketDescriptor);
-                socketDescriptor = -1;
-                continue;
+            if (dispatched) continue;
+            if (_stopDispatchThread) {
+                if (_outputBatch) flushOutputBatch();
+                break;
             }
 
-            struct sockaddr clientInfo{};
-            uint32_t addressLength = sizeof(sockaddr);
-            ssize_t bytesRead = 0;
-            do {
-                bytesRead = recvfrom(socketDescriptor, buffer.data(), buffer.size(), 0, &clientInfo, &addressLength);
-            } while (bytesRead < 0 && (errno == EAGAIN || errno == EINTR));
+            std::unique_lock<std::mutex> dispatchGuard(_dispatchMutex);
+            _dispatchWaiting = true;
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            auto hasWork = [&] {
+                if (_stopDispatchThread) return true;
+                for (auto &ring : _rings) {
+                    if (!ring->empty()) return true;
+                }
+                return false;
+            };
+            auto wakeup = std::chrono::steady_clock::time_point::max();
+            if (_metricsInterval > 0) wakeup = nextMetricsOutput;
+            if (_outputBatch) wakeup = std::min(wakeup, _outputBatchDeadline);
+            if (wakeup != std::chrono::steady_clock::time_point::max()) _dispatchConditionVariable.wait_until(dispatchGuard, wakeup, hasWork);
+            else _dispatchConditionVariable.wait(dispatchGuard, hasWork);
+            _dispatchWaiting = false;
+        }
+    }
+    catch (const std::exception &ex) {
+        _out->printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+    }
+}
+
+void Ekey::processDatagrams(const Datagram *datagrams, uint32_t count) {
+    //The decoder is selected once per run of datagrams of one protocol. Consecutive HOME or MULTI packets are decoded as
+    //one batch. Events keep their order.
+    uint32_t index = 0;
+    while (index < count) {
+        Protocol protocol = datagrams[index].protocol;
+        uint32_t end = index + 1;
+        while (end < count && datagrams[end].protocol == protocol) end++;
+        if (_payloadType == PayloadType::raw) protocol = Protocol::automatic;
+        switch (protocol) {
+            case Protocol::rare:
+                processRun<Protocol::rare>(datagrams + index, end - index);
+                break;
+            case Protocol::home:
+                processRun<Protocol::home>(datagrams + index, end - index);
+                break;
+            case Protocol::multi:
+                processRun<Protocol::multi>(datagrams + index, end - index);
+                break;
+            default:
+                for (uint32_t i = index; i < end; i++) {
+                    processDatagram(datagrams[i]);
+                }
+                break;
+        }
+        index = end;
+    }
+}
+
+template<Protocol protocol>
+void Ekey::processRun(const Datagram *datagrams, uint32_t count) {
+    if constexpr (protocol != Protocol::rare) {
+        if (count > 1) {
+            processBatch<protocol>(datagrams, count);
+            return;
+        }
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        decodeDatagram<protocol>(datagrams[i]);
+    }
+}
+
+template<Protocol protocol>
+void Ekey::processBatch(const Datagram *datagrams, uint32_t count) {
+    try {
+        std::array<std::string_view, maxDispatchBatch> packets;
+        std::array<int64_t, maxDispatchBatch> receiveTimes;
+        std::array<Flows::PVariable, maxDispatchBatch> messages;
+        for (uint32_t i = 0; i < count; i++) {
+            packets[i] = datagrams[i].view();
+            messages[i] = createMessage(datagrams[i], receiveTimes[i]);
+            if (_logLevel >= 4) _out->printMessage(std::string(protocol == Protocol::home ? "Process Home Packet" : "Process Multi Packet") + " -> 0x" + Flows::HelperFunctions::getHexString(std::string(packets[i])), 4);
+        }
+
+        //Like for single packets, the decode latency includes the conversion into variables
+        std::array<Flows::PVariable, maxDispatchBatch> vars;
+        std::array<Refusal, maxDispatchBatch> refusals;
+        auto decodeStart = std::chrono::steady_clock::now();
+        auto &columns = [&]() -> auto & {
+            if constexpr (protocol == Protocol::home) return _homeColumns;
+            else return _multiColumns;
+        }();
+        if constexpr (protocol == Protocol::home) BatchDecoder::decodeHome(packets.data(), count, columns);
+        else BatchDecoder::decodeMulti(packets.data(), count, columns);
+        for (uint32_t i = 0; i < count; i++) {
+            if (columns.error[i] != ParseError::none) continue;
+            vars[i] = std::make_shared<Flows::Variable>(Flows::VariableType::tStruct);
+            if constexpr (protocol == Protocol::home) addHomeFields(columns.getPacket(i), vars[i], refusals[i]);
+            else addMultiFields(columns.getPacket(i), vars[i], refusals[i]);
+        }
+        auto decodeTime = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - decodeStart).count() / count;
 
-            if (bytesRead <= 0) {
-                close(socketDescriptor);
-                socketDescriptor = -1;
+        auto &decodeLatency = _metrics.getDecodeLatency(protocol);
+        for (uint32_t i = 0; i < count; i++) {
+            decodeLatency.record(decodeTime);
+            if (columns.error[i] != ParseError::none) {
+                printParseError(columns.error[i], packets[i]);
                 continue;
             }
+            emitDecodedEvent(datagrams[i], protocol, messages[i], vars[i], refusals[i], receiveTimes[i]);
+        }
+    }
+    catch (const std::exception &ex) {
+        _out->printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+    }
+}
 
-            std::array<char, INET6_ADDRSTRLEN + 1> ipStringBuffer{};
-            if (clientInfo.sa_family == AF_INET) {
-                auto *s = (struct sockaddr_in *)&clientInfo;
-                inet_ntop(AF_INET, &s->sin_addr, ipStringBuffer.data(), ipStringBuffer.size());
-            } else { // AF_INET6
-                auto *s = (struct sockaddr_in6 *)&clientInfo;
-                inet_ntop(AF_INET6, &s->sin6_addr, ipStringBuffer.data(), ipStringBuffer.size());
-            }
-            ipStringBuffer.back() = 0;
-            auto senderIp = std::string(ipStringBuffer.data());
+template<Protocol protocol>
+void Ekey::decodeDatagram(const Datagram &datagram) {
+    try {
+        int64_t receiveTime = 0;
+        Flows::PVariable message = createMessage(datagram, receiveTime);
+
+        auto packet = datagram.view();
+        Flows::PVariable var = std::make_shared<Flows::Variable>(Flows::VariableType::tStruct);
+        Refusal refusal;
+        bool decoded = false;
+        auto decodeStart = std::chrono::steady_clock::now();
+        if constexpr (protocol == Protocol::rare) decoded = processRarePacket(packet, var);
+        else if constexpr (protocol == Protocol::home) decoded = processHomePacket(packet, var, refusal);
+        else decoded = processMultiPacket(packet, var, refusal);
+        _metrics.getDecodeLatency(protocol).record((uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - decodeStart).count());
+        if (!decoded) return;
+        emitDecodedEvent(datagram, protocol, message, var, refusal, receiveTime);
+    }
+    catch (const std::exception &ex) {
+        _out->printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+    }
+}
 
-            Flows::PVariable message = std::make_shared<Flows::Variable>(Flows::VariableType::tStruct);
-            message->structValue->emplace("senderIp", std::make_shared<Flows::Variable>(senderIp));
+Flows::PVariable Ekey::createMessage(const Datagram &datagram, int64_t &receiveTime) {
+    //System clock in nanoseconds. The messages carry microseconds, which JavaScript numbers still hold exactly.
+    receiveTime = datagram.receiveTime;
+    int64_t dispatchTime = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
 
-            std::string packet(buffer.begin(),buffer.begin() + bytesRead);
-            Flows::PVariable var = std::make_shared<Flows::Variable>(Flows::VariableType::tStruct);
-            if(_protocol == "rare") processRarePacket(packet, var);
-            else if (_protocol == "home") processHomePacket(packet, var);
-            else if (_protocol == "multi") processMultiPacket(packet, var);
+    Flows::PVariable message = std::make_shared<Flows::Variable>(Flows::VariableType::tStruct);
+    message->structValue->emplace(_interned->senderIpKey, getSenderIp(datagram.sender));
+    message->structValue->emplace(_interned->receiveTimeKey, std::make_shared<Flows::Variable>(receiveTime / 1000));
+    message->structValue->emplace(_interned->dispatchTimeKey, std::make_shared<Flows::Variable>(dispatchTime / 1000));
+    return message;
+}
+
+void Ekey::emitDecodedEvent(const Datagram &datagram, Protocol protocol, const Flows::PVariable &message, const Flows::PVariable &var, const Refusal &refusal, int64_t receiveTime) {
+    if (refusal.refused && _refusalCounter && correlateRefusal(datagram, protocol, refusal, receiveTime)) return;
+
+    message->structValue->emplace(_interned->protocolKey, _interned->getProtocolName(protocol));
+    message->structValue->emplace(_interned->payloadKey, var);
+    emitEvent(message, receiveTime);
+}
 
-            message->structValue->emplace("payload", var);
-            output(0, message);
+void Ekey::processDatagram(const Datagram &datagram) {
+    try {
+        auto packet = datagram.view();
+        Protocol protocol = datagram.protocol;
+        if (_payloadType == PayloadType::raw) {
+            //Nothing is decoded. The protocol is only detected to tell the flow which decoder applies.
+            int64_t receiveTime = 0;
+            Flows::PVariable message = createMessage(datagram, receiveTime);
+            if (protocol == Protocol::automatic) PacketParser::detectProtocol(packet, protocol);
+            message->structValue->emplace(_interned->senderPortKey, std::make_shared<Flows::Variable>((int32_t)datagram.sender.port));
+            message->structValue->emplace(_interned->protocolKey, _interned->getProtocolName(protocol));
+            message->structValue->emplace(_interned->payloadKey, std::make_shared<Flows::Variable>(std::vector<uint8_t>(packet.begin(), packet.end())));
+            emitEvent(message, receiveTime);
+            return;
+        }
+
+        //Only auto-detected packets get here, their protocol is not known before
+        if (!PacketParser::detectProtocol(packet, protocol)) {
+            Metrics::increment(_metrics.unknownProtocols);
+            _out->printError("dropping packet of unknown format. packet was " + std::to_string(packet.size()) + " bytes long and is 0x" + Flows::HelperFunctions::getHexString(std::string(packet)));
+            return;
+        }
+        switch (protocol) {
+            case Protocol::rare:
+                decodeDatagram<Protocol::rare>(datagram);
+                break;
+            case Protocol::home:
+                decodeDatagram<Protocol::home>(datagram);
+                break;
+            case Protocol::multi:
+                decodeDatagram<Protocol::multi>(datagram);
+                break;
+            default:
+                Metrics::increment(_metrics.unknownProtocols);
+                break;
+        }
+    }
+    catch (const std::exception &ex) {
+        _out->printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+    }
+}
+
+void Ekey::emitEvent(const Flows::PVariable &message, int64_t receiveTime) {
+    Metrics::increment(_metrics.emittedEvents);
+    if (_outputBatchSize <= 1) {
+        output(0, message);
+        Metrics::increment(_metrics.outputMessages);
+        recordOutputLatency(receiveTime);
+        return;
+    }
+
+    if (!_outputBatch) {
+        _outputBatch = std::make_shared<Flows::Variable>(Flows::VariableType::tArray);
+        _outputBatch->arrayValue->reserve(_outputBatchSize);
+        _outputBatchDeadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(_outputBatchTimeout);
+    }
+    _outputBatch->arrayValue->push_back(message);
+    _outputBatchReceiveTimes.push_back(receiveTime);
+    if (_outputBatch->arrayValue->size() >= _outputBatchSize) flushOutputBatch();
+}
+
+void Ekey::flushOutputBatch() {
+    //Events are appended in dispatch order, so the array preserves the order of reception per listen thread
+    Flows::PVariable message = std::make_shared<Flows::Variable>(Flows::VariableType::tStruct);
+    message->structValue->emplace(_interned->payloadKey, std::move(_outputBatch));
+    _outputBatch.reset();
+    output(0, message);
+    Metrics::increment(_metrics.outputMessages);
+    //Every event of the batch waited for the output of the whole array
+    for (auto receiveTime : _outputBatchReceiveTimes) {
+        recordOutputLatency(receiveTime);
+    }
+    _outputBatchReceiveTimes.clear();
+}
+
+void Ekey::recordOutputLatency(int64_t receiveTime) {
+    int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    _metrics.outputLatency.record((uint64_t)std::max((int64_t)0, now - receiveTime));
+}
+
+bool Ekey::correlateRefusal(const Datagram &datagram, Protocol protocol, const Refusal &refusal, int64_t receiveTime) {
+    //Scanners are identified by their serial number, one that is not numeric is hashed instead
+    int64_t serialNumber = PacketParser::getSerialNumber(refusal.serialNr);
+    uint64_t scanner = serialNumber >= 0 ? (uint64_t)serialNumber : std::hash<std::string_view>()(refusal.serialNr);
+    //Counted with the receive time the messages carry, so firstRefusal matches the receiveTime of the refused events
+    int64_t firstRefusal = 0;
+    if (_refusalCounter->add(scanner, receiveTime, firstRefusal)) {
+        Metrics::increment(_metrics.refusalAlarms);
+        Flows::PVariable alarm = std::make_shared<Flows::Variable>(Flows::VariableType::tStruct);
+        alarm->structValue->emplace(_interned->serialNrKey, std::make_shared<Flows::Variable>(std::string(refusal.serialNr)));
+        if (protocol == Protocol::multi) alarm->structValue->emplace(_interned->readerNameKey, std::make_shared<Flows::Variable>(stripPadding(refusal.readerName)));
+        alarm->structValue->emplace("refusals", std::make_shared<Flows::Variable>((int32_t)_refusalCounter->threshold()));
+        alarm->structValue->emplace("window", std::make_shared<Flows::Variable>((int32_t)_refusalWindow));
+        alarm->structValue->emplace("firstRefusal", std::make_shared<Flows::Variable>(firstRefusal / 1000));
+
+        Flows::PVariable message = std::make_shared<Flows::Variable>(Flows::VariableType::tStruct);
+        message->structValue->emplace(_interned->senderIpKey, getSenderIp(datagram.sender));
+        message->structValue->emplace(_interned->receiveTimeKey, std::make_shared<Flows::Variable>(receiveTime / 1000));
+        message->structValue->emplace(_interned->protocolKey, _interned->getProtocolName(protocol));
+        message->structValue->emplace(_interned->payloadKey, alarm);
+        //Output 1 carries the metrics
+        output(2, message);
+    }
+
+    if (_suppressRefusals) Metrics::increment(_metrics.suppressedRefusals);
+    return _suppressRefusals;
+}
+
+Flows::PVariable Ekey::getSenderIp(const SenderKey &sender) {
+    auto address = sender.getAddressKey();
+    auto senderIterator = _senderIpCache.find(address);
+    if (senderIterator != _senderIpCache.end()) return senderIterator->second;
+
+    //Only a handful of converters send to one node, so the cache is simply started over when it is full
+    if (_senderIpCache.size() >= maxSenderIpCacheSize) _senderIpCache.clear();
+    auto senderIp = std::make_shared<Flows::Variable>(address.getAddressString());
+    _senderIpCache.emplace(address, senderIp);
+    return senderIp;
+}
+
+void Ekey::outputMetrics() {
+    try {
+        auto load = [](const std::atomic<uint64_t> &counter) {
+            return std::make_shared<Flows::Variable>((int64_t)counter.load(std::memory_order_relaxed));
+        };
+        auto sum = [&](std::atomic<uint64_t> WorkerMetrics::*counter) {
+            return std::make_shared<Flows::Variable>((int64_t)_metrics.sum(counter));
+        };
+
+        Flows::PVariable drops = std::make_shared<Flows::Variable>(Flows::VariableType::tStruct);
+        drops->structValue->emplace("queueOverflow", sum(&WorkerMetrics::queueOverflows));
+        drops->structValue->emplace("duplicate", sum(&WorkerMetrics::duplicates));
+        drops->structValue->emplace("rejectedSender", sum(&WorkerMetrics::rejectedSenders));
+        drops->structValue->emplace("rateLimited", sum(&WorkerMetrics::rateLimited));
+        drops->structValue->emplace("oversized", sum(&WorkerMetrics::oversizedDatagrams));
+        drops->structValue->emplace("lengthMismatch", load(_metrics.lengthMismatches));
+        drops->structValue->emplace("badDigit", load(_metrics.badDigits));
+        drops->structValue->emplace("badSeparator", load(_metrics.badSeparators));
+        drops->structValue->emplace("badTerminalAddress", load(_metrics.badTerminalAddresses));
+        drops->structValue->emplace("unknownProtocol", load(_metrics.unknownProtocols));
+        drops->structValue->emplace("kernel", sum(&WorkerMetrics::kernelDrops));
+        drops->structValue->emplace("receiveError", sum(&WorkerMetrics::receiveErrors));
+        drops->structValue->emplace("socketError", sum(&WorkerMetrics::socketErrors));
+        drops->structValue->emplace("rebind", sum(&WorkerMetrics::rebinds));
+
+        Flows::PVariable decodeLatency = std::make_shared<Flows::Variable>(Flows::VariableType::tStruct);
+        for (auto protocol : {Protocol::rare, Protocol::home, Protocol::multi}) {
+            decodeLatency->structValue->emplace(std::string(PacketParser::getProtocolName(protocol)), getHistogramVariable(_metrics.getDecodeLatency(protocol)));
         }
 
-        close(socketDescriptor);
+        Flows::PVariable metrics = std::make_shared<Flows::Variable>(Flows::VariableType::tStruct);
+        metrics->structValue->emplace("receivedDatagrams", sum(&WorkerMetrics::receivedDatagrams));
+        metrics->structValue->emplace("receivedBytes", sum(&WorkerMetrics::receivedBytes));
+        metrics->structValue->emplace("receivedBatches", sum(&WorkerMetrics::receivedBatches));
+        metrics->structValue->emplace("enqueuedDatagrams", sum(&WorkerMetrics::enqueuedDatagrams));
+        metrics->structValue->emplace("dispatchedDatagrams", load(_metrics.dispatchedDatagrams));
+        metrics->structValue->emplace("emittedEvents", load(_metrics.emittedEvents));
+        metrics->structValue->emplace("outputMessages", load(_metrics.outputMessages));
+        metrics->structValue->emplace("refusalAlarms", load(_metrics.refusalAlarms));
+        metrics->structValue->emplace("suppressedRefusals", load(_metrics.suppressedRefusals));
+        metrics->structValue->emplace("drops", drops);
+        metrics->structValue->emplace("decodeLatency", decodeLatency);
+        LatencyHistogram socketLatency;
+        _metrics.getSocketLatency(socketLatency);
+        metrics->structValue->emplace("socketLatency", getHistogramVariable(socketLatency));
+        metrics->structValue->emplace("outputLatency", getHistogramVariable(_metrics.outputLatency));
+
+        Flows::PVariable message = std::make_shared<Flows::Variable>(Flows::VariableType::tStruct);
+        message->structValue->emplace("payload", metrics);
+        output(1, message);
     }
     catch (const std::exception &ex) {
         _out->printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
     }
 }
 
-void Ekey::processRarePacket(const std::string &data, Flows::PVariable &var) {
+Flows::PVariable Ekey::getHistogramVariable(const LatencyHistogram &histogram) {
+    //All values in nanoseconds
+    Flows::PVariable result = std::make_shared<Flows::Variable>(Flows::VariableType::tStruct);
+    result->structValue->emplace("count", std::make_shared<Flows::Variable>((int64_t)histogram.count()));
+    result->structValue->emplace("p50", std::make_shared<Flows::Variable>((int64_t)histogram.getValueAtQuantile(0.5)));
+    result->structValue->emplace("p90", std::make_shared<Flows::Variable>((int64_t)histogram.getValueAtQuantile(0.9)));
+    result->structValue->emplace("p99", std::make_shared<Flows::Variable>((int64_t)histogram.getValueAtQuantile(0.99)));
+    result->structValue->emplace("p999", std::make_shared<Flows::Variable>((int64_t)histogram.getValueAtQuantile(0.999)));
+    result->structValue->emplace("max", std::make_shared<Flows::Variable>((int64_t)histogram.max()));
+    return result;
+}
+
+bool Ekey::processRarePacket(std::string_view data, Flows::PVariable &var) {
 
 /*RARE 72 Byte
     1   nVersion            long            3
@@ -271,23 +1317,55 @@ void Ekey::processRarePacket(const std::string &data, Flows::PVariable &var) {
 
     Calculate Terminal Address
     aaaaaa ww yy ssss
-    Adresse = (((yy * 53 + ww) * 655367)) + ssss) + 0x70000000
+    Adresse = ((yy * 53 + ww) * 65536) + ssss + 0x70000000
  */
     try{
-        _out->printMessage("Process Rare Packet -> 0x" + Flows::HelperFunctions::getHexString(data),4);
-        //if(data.length() != 72) {
-        //    _out->printError("dropping packet because of length mismatch. packet was " + std::to_string(data.length()) + " bytes long and is 0x" + Flows::HelperFunctions::getHexString(data));
-        //    return;
-        //}
-        var->structValue->emplace("version", std::make_shared<Flows::Variable>(std::stoi(data.substr(0, 8), nullptr, 16)));
+        if (_logLevel >= 4) _out->printMessage("Process Rare Packet -> 0x" + Flows::HelperFunctions::getHexString(std::string(data)),4);
+        RarePacket packet;
+        auto error = PacketParser::parseRare(data, packet);
+        if (error != ParseError::none) {
+            printParseError(error, data);
+            return false;
+        }
 
+        auto &values = *_interned;
+        if (_payloadType == PayloadType::compact) {
+            var->structValue->emplace(values.versionKey, std::make_shared<Flows::Variable>((int64_t)packet.version));
+            var->structValue->emplace(values.commandKey, std::make_shared<Flows::Variable>((int64_t)packet.command));
+            var->structValue->emplace(values.terminalIdKey, std::make_shared<Flows::Variable>((int64_t)packet.terminalId));
+            var->structValue->emplace(values.serialNrKey, std::make_shared<Flows::Variable>(PacketParser::getSerialNumber(packet)));
+            var->structValue->emplace(values.relaysIdKey, values.getInteger(packet.relayId));
+            var->structValue->emplace(values.userIdKey, std::make_shared<Flows::Variable>(packet.userId));
+            var->structValue->emplace(values.fingerIdKey, values.getInteger(packet.fingerId));
+            var->structValue->emplace(values.actionKey, values.getInteger(packet.action));
+            var->structValue->emplace(values.nameKey, std::make_shared<Flows::Variable>((int32_t)packet.name));
+            var->structValue->emplace(values.personalIdKey, std::make_shared<Flows::Variable>((int32_t)packet.personalId));
+            return true;
+        }
+
+        var->structValue->emplace(values.versionKey, std::make_shared<Flows::Variable>((int64_t)packet.version));
+        var->structValue->emplace(values.commandKey, std::make_shared<Flows::Variable>((int64_t)packet.command));
+        var->structValue->emplace(values.terminalIdKey, std::make_shared<Flows::Variable>((int64_t)packet.terminalId));
+        var->structValue->emplace(values.serialNrKey, std::make_shared<Flows::Variable>(PacketParser::getSerialNr(packet)));
+        var->structValue->emplace(values.relaysIdKey, values.getInteger(packet.relayId));
+        var->structValue->emplace(values.relayKey, values.getRelayName(packet.relayId));
+        var->structValue->emplace(values.userIdKey, std::make_shared<Flows::Variable>(packet.userId));
+        var->structValue->emplace(values.fingerIdKey, values.getInteger(packet.fingerId));
+        var->structValue->emplace(values.fingerKey, values.getFingerName(packet.fingerId));
+        var->structValue->emplace(values.actionKey, values.getHomeActionName(packet.action));
+        var->structValue->emplace(values.eventKey, std::make_shared<Flows::Variable>(std::string(packet.event)));
+        var->structValue->emplace(values.timeKey, std::make_shared<Flows::Variable>(std::string(packet.time)));
+        var->structValue->emplace(values.nameKey, std::make_shared<Flows::Variable>((int32_t)packet.name));
+        var->structValue->emplace(values.personalIdKey, std::make_shared<Flows::Variable>((int32_t)packet.personalId));
+        return true;
     }
     catch (const std::exception &ex) {
         _out->printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
     }
+    return false;
 }
 
-void Ekey::processHomePacket(const std::string &data, Flows::PVariable &var) {
+bool Ekey::processHomePacket(std::string_view data, Flows::PVariable &var, Refusal &refusal) {
 /*Home 22 Byte
     PAKETTYP    1 String                1           Pakettyp „Nutzdaten“
     USER ID     4 String (dezimal)      0000-9999   Benutzernummer (Default 0000)
@@ -321,53 +1399,23 @@ void Ekey::processHomePacket(const std::string &data, Flows::PVariable &var) {
     nok, 1_0000_–_80156809150025_2_-
  */
     try {
-        _out->printMessage("Process Home Packet -> 0x" + Flows::HelperFunctions::getHexString(data),4);
-        if(data.length() != 27){
-            _out->printError("dropping packet because of length mismatch. packet was " + std::to_string(data.length()) + " bytes long and is 0x" + Flows::HelperFunctions::getHexString(data));
-            return;
+        if (_logLevel >= 4) _out->printMessage("Process Home Packet -> 0x" + Flows::HelperFunctions::getHexString(std::string(data)),4);
+        HomePacket packet;
+        auto error = PacketParser::parseHome(data, packet);
+        if (error != ParseError::none) {
+            printParseError(error, data);
+            return false;
         }
-
-        var->structValue->emplace("packetType", std::make_shared<Flows::Variable>(std::stoi(data.substr(0,1))));
-        var->structValue->emplace("userId", std::make_shared<Flows::Variable>(std::stoi(data.substr(2,4))));
-
-        auto fingerId = data.substr(7,1);
-        std::string finger;
-        int32_t iFinger;
-        getFinger(fingerId, finger, iFinger);
-        var->structValue->emplace("fingerId", std::make_shared<Flows::Variable>(iFinger));
-        var->structValue->emplace("finger", std::make_shared<Flows::Variable>(finger));
-        var->structValue->emplace("serialNr", std::make_shared<Flows::Variable>(data.substr(9, 14)));
-
-        int32_t iAction = std::stoi(data.substr(24, 1));
-        std::string action;
-        if(iAction == 1) action = "open";
-        else if (iAction == 2) action = "refuse";
-
-        var->structValue->emplace("action", std::make_shared<Flows::Variable>(action));
-
-        auto relaysId = data.substr(26,1);
-        int32_t iRelays;
-        std::string relays;
-        if(relaysId == "d"){
-            relays = "Multiple Relays";
-            iRelays = -1;
-        } else if (relaysId == "-"){
-            relays = "none";
-            iRelays = -2;
-        } else {
-            iRelays = std::stoi(relaysId);
-            relays = "Relays" + std::to_string(iRelays);
-        }
-
-        var->structValue->emplace("relaysId", std::make_shared<Flows::Variable>(iRelays));
-        var->structValue->emplace("relay", std::make_shared<Flows::Variable>(relays));
+        addHomeFields(packet, var, refusal);
+        return true;
     }
     catch (const std::exception &ex) {
         _out->printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
     }
+    return false;
 }
 
-void Ekey::processMultiPacket(const std::string &data, Flows::PVariable &var) {
+bool Ekey::processMultiPacket(std::string_view data, Flows::PVariable &var, Refusal &refusal) {
 /*Multi 37 Byte
     PAKETTYP    1 String                1           Pakettyp „Nutzdaten“
     USER ID     4 String (dezimal)      0000-9999   Benutzernummer (Default 0000)
@@ -419,106 +1467,90 @@ void Ekey::processMultiPacket(const std::string &data, Flows::PVariable &var) {
     nok 1_0003_JOSEF----_1_7_2_80156809150025_GAR-_3_-
  */
     try{
-        _out->printInfo("***************************************");
-        _out->printMessage("Process Multi Packet -> 0x" + Flows::HelperFunctions::getHexString(data),4);
-        if(data.length() != 37){
-            _out->printError("dropping packet because of length mismatch. packet was " + std::to_string(data.length()) + " bytes long and is 0x" + Flows::HelperFunctions::getHexString(data));
-            return;
+        if (_logLevel >= 4) _out->printMessage("Process Multi Packet -> 0x" + Flows::HelperFunctions::getHexString(std::string(data)),4);
+        MultiPacket packet;
+        auto error = PacketParser::parseMulti(data, packet);
+        if (error != ParseError::none) {
+            printParseError(error, data);
+            return false;
         }
-
-        var->structValue->emplace("packetType", std::make_shared<Flows::Variable>(std::stoi(data.substr(0,1))));
-        var->structValue->emplace("userId", std::make_shared<Flows::Variable>(std::stoi(data.substr(1,4))));
-        std::string userName = data.substr(5,9);
-        userName.erase(std::remove(userName.begin(), userName.end(), '-'), userName.end());
-        var->structValue->emplace("username", std::make_shared<Flows::Variable>(userName));
-
-        auto userStateId = data.substr(14, 1);
-        std::string userState;
-        if(userStateId == "-") userState = "undefined";
-        else {
-            int32_t iUserState = std::stoi(userStateId);
-            if (iUserState == 0) userState = "user inactive";
-            else if (iUserState == 1) userState = "user active";
-        }
-        var->structValue->emplace("userState", std::make_shared<Flows::Variable>(userState));
-
-        auto fingerId = data.substr(15,1);
-        std::string finger;
-        int32_t iFinger;
-        getFinger(fingerId, finger, iFinger);
-        var->structValue->emplace("fingerId", std::make_shared<Flows::Variable>(iFinger));
-        var->structValue->emplace("finger", std::make_shared<Flows::Variable>(finger));
-
-        auto keyId = data.substr(16, 1);
-        std::string key;
-        if(keyId == "-") key = "Mainkey";
-        else {
-            int32_t iKeyId = std::stoi(keyId);
-            key = "Key " + std::to_string(iKeyId);
-        }
-        var->structValue->emplace("key", std::make_shared<Flows::Variable>(key));
-
-        var->structValue->emplace("serialNr", std::make_shared<Flows::Variable>(data.substr(17, 14)));
-
-        std::string readerName = data.substr(31,4);
-        readerName.erase(std::remove(readerName.begin(), readerName.end(), '-'), readerName.end());
-        var->structValue->emplace("readerName", std::make_shared<Flows::Variable>(readerName));
-
-        int32_t iAction = std::stoi(data.substr(35, 1), nullptr, 16);
-        std::string action;
-        if(iAction == 1) action = "open";
-        else if (iAction == 2) action = "refuse unknown finger";
-        else if (iAction == 3) action = "refuse time slot A";
-        else if (iAction == 4) action = "refuse time slot B";
-        else if (iAction == 5) action = "refuse disabled";
-        else if (iAction == 6) action = "refuse \"Only always users\"";
-        else if (iAction == 7) action = "scanner not connected to control panel";
-        else if (iAction == 8) action = "digital input";
-        else if (iAction == 0xA) action = "codepad 1 min. lock";
-        else if (iAction == 0xb) action = "codepad 15 min. lock";
-        var->structValue->emplace("action", std::make_shared<Flows::Variable>(action));
-
-        auto inputId = data.substr(36, 1);
-        std::string input;
-        if(inputId == "-") input = "no digital input";
-        else {
-            int32_t iInputId = std::stoi(inputId);
-            input = "Input " + std::to_string(iInputId);
-        }
-        var->structValue->emplace("input", std::make_shared<Flows::Variable>(input));
-
+        addMultiFields(packet, var, refusal);
+        return true;
     }
     catch (const std::exception &ex) {
         _out->printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
     }
+    return false;
 }
 
-    void Ekey::getFinger(const std::string &fingerId, std::string &finger, int32_t &iFinger) {
-        if(fingerId == "R"){
-            finger = "RFID";
-            iFinger = -1;
-        } else if (fingerId == "-"){
-            finger = "Unknown Finger";
-            iFinger = -2;
-        } else {
-            iFinger = std::stoi(fingerId);
-            if(iFinger < 6 && iFinger > 0){
-                finger = "Left Hand";
-            } else {
-                finger = "Right Hand";
-            }
+void Ekey::addHomeFields(const HomePacket &packet, Flows::PVariable &var, Refusal &refusal) {
+    refusal.refused = PacketParser::isRefusal(packet);
+    refusal.serialNr = packet.serialNr;
+
+    auto &values = *_interned;
+    if (_payloadType == PayloadType::compact) {
+        var->structValue->emplace(values.packetTypeKey, values.getInteger(packet.packetType));
+        var->structValue->emplace(values.userIdKey, std::make_shared<Flows::Variable>(packet.userId));
+        var->structValue->emplace(values.fingerIdKey, values.getInteger(packet.fingerId));
+        var->structValue->emplace(values.serialNrKey, std::make_shared<Flows::Variable>(PacketParser::getSerialNumber(packet.serialNr)));
+        var->structValue->emplace(values.actionKey, values.getInteger(packet.action));
+        var->structValue->emplace(values.relaysIdKey, values.getInteger(packet.relayId));
+        return;
+    }
 
-            if(iFinger == 1 || iFinger == 0){
-                finger.append(" Pinky");
-            } else if (iFinger == 2 || iFinger == 9) {
-                finger.append(" Ring Finger");
-            } else if (iFinger == 3 || iFinger == 8) {
-                finger.append(" Middle Finger");
-            } else if (iFinger == 4 || iFinger == 7) {
-                finger.append(" Index Finger");
-            } else if (iFinger == 5 || iFinger == 6) {
-                finger.append(" Thumb");
-            }
-        }
+    var->structValue->emplace(values.packetTypeKey, values.getInteger(packet.packetType));
+    var->structValue->emplace(values.userIdKey, std::make_shared<Flows::Variable>(packet.userId));
+    var->structValue->emplace(values.fingerIdKey, values.getInteger(packet.fingerId));
+    var->structValue->emplace(values.fingerKey, values.getFingerName(packet.fingerId));
+    var->structValue->emplace(values.serialNrKey, std::make_shared<Flows::Variable>(std::string(packet.serialNr)));
+    var->structValue->emplace(values.actionKey, values.getHomeActionName(packet.action));
+    var->structValue->emplace(values.relaysIdKey, values.getInteger(packet.relayId));
+    var->structValue->emplace(values.relayKey, values.getRelayName(packet.relayId));
+}
+
+void Ekey::addMultiFields(const MultiPacket &packet, Flows::PVariable &var, Refusal &refusal) {
+    refusal.refused = PacketParser::isRefusal(packet);
+    refusal.serialNr = packet.serialNr;
+    refusal.readerName = packet.readerName;
+
+    auto &values = *_interned;
+    if (_payloadType == PayloadType::compact) {
+        var->structValue->emplace(values.packetTypeKey, values.getInteger(packet.packetType));
+        var->structValue->emplace(values.userIdKey, std::make_shared<Flows::Variable>(packet.userId));
+        var->structValue->emplace(values.userStateKey, values.getInteger(packet.userState));
+        var->structValue->emplace(values.fingerIdKey, values.getInteger(packet.fingerId));
+        var->structValue->emplace(values.keyIdKey, values.getInteger(packet.keyId));
+        var->structValue->emplace(values.serialNrKey, std::make_shared<Flows::Variable>(PacketParser::getSerialNumber(packet.serialNr)));
+        var->structValue->emplace(values.actionKey, values.getInteger(packet.action));
+        var->structValue->emplace(values.inputIdKey, values.getInteger(packet.inputId));
+        return;
     }
+
+    var->structValue->emplace(values.packetTypeKey, values.getInteger(packet.packetType));
+    var->structValue->emplace(values.userIdKey, std::make_shared<Flows::Variable>(packet.userId));
+    var->structValue->emplace(values.userNameKey, std::make_shared<Flows::Variable>(stripPadding(packet.userName)));
+    var->structValue->emplace(values.userStateKey, values.getUserStateName(packet.userState));
+    var->structValue->emplace(values.fingerIdKey, values.getInteger(packet.fingerId));
+    var->structValue->emplace(values.fingerKey, values.getFingerName(packet.fingerId));
+    var->structValue->emplace(values.keyKey, values.getKeyName(packet.keyId));
+    var->structValue->emplace(values.serialNrKey, std::make_shared<Flows::Variable>(std::string(packet.serialNr)));
+    var->structValue->emplace(values.readerNameKey, std::make_shared<Flows::Variable>(stripPadding(packet.readerName)));
+    var->structValue->emplace(values.actionKey, values.getMultiActionName(packet.action));
+    var->structValue->emplace(values.inputKey, values.getInputName(packet.inputId));
+}
+
+void Ekey::printParseError(ParseError error, std::string_view data) {
+    _metrics.countParseError(error);
+    _out->printError("dropping packet because of " + std::string(PacketParser::getErrorString(error)) + ". packet was " + std::to_string(data.length()) + " bytes long and is 0x" + Flows::HelperFunctions::getHexString(std::string(data)));
+}
+
+std::string Ekey::stripPadding(std::string_view field) {
+    std::string result;
+    result.reserve(field.size());
+    for (auto c : field) {
+        if (c != '-') result.push_back(c);
+    }
+    return result;
+}
+
 }
\ No newline at end of file
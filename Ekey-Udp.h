@@ -3,7 +3,27 @@
 
 #include <homegear-node/NodeFactory.h>
 #include <homegear-node/INode.h>
+#include "BatchDecoder.h"
+#include "CaptureFile.h"
+#include "DatagramRing.h"
+#include "DuplicateFilter.h"
+#include "InternedValues.h"
+#include "Metrics.h"
+#include "PacketParser.h"
+#include "RefusalCounter.h"
+#include "SenderFilter.h"
+#include "SocketStore.h"
+#include <sys/socket.h>
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <ctime>
+#include <memory>
+#include <mutex>
+#include <string>
 #include <thread>
+#include <unordered_map>
+#include <vector>
 
 class MyFactory : Flows::NodeFactory {
 public:
@@ -25,24 +45,179 @@ public:
     void waitForStop() override;
 private:
     enum class PayloadType {
-        raw,
-        hex,
-        json
+        full, //Decoded fields with names
+        compact, //Integer codes only
+        raw //Undecoded bytes
     };
 
+    struct ReceiveBatch {
+        static constexpr size_t bufferSize = 4096;
+        static constexpr uint32_t maxSize = 1024; //The kernel caps recvmmsg at UIO_MAXIOV messages per call
+        static constexpr size_t controlSize = CMSG_SPACE(sizeof(timespec)) + CMSG_SPACE(sizeof(uint32_t));
+
+        struct ControlBuffer {
+            alignas(cmsghdr) std::array<uint8_t, controlSize> data;
+        };
+
+        explicit ReceiveBatch(uint32_t size);
+        void prepare(uint32_t offset);
+        /**
+         * Reads the control messages of message index.
+         *
+         * @param kernelTime Receives the kernel receive time in nanoseconds since the epoch or 0 if there is none.
+         * @param dropCount Receives the number of datagrams the kernel dropped on the socket so far (SO_RXQ_OVFL). Left
+         * unchanged if the message does not carry it.
+         */
+        void getControlData(uint32_t index, int64_t &kernelTime, uint32_t &dropCount);
+
+        std::vector<std::array<uint8_t, bufferSize>> buffers;
+        std::vector<sockaddr_storage> senders;
+        std::vector<ControlBuffer> controls;
+        std::vector<iovec> iovecs;
+        std::vector<mmsghdr> headers;
+    };
+
+    /**
+     * Scanner of a decoded packet that refused access.
+     */
+    struct Refusal {
+        bool refused = false;
+        std::string_view serialNr;
+        std::string_view readerName; //MULTI only
+    };
+
+    struct Endpoint {
+        std::string address;
+        uint16_t port = 0;
+        Protocol protocol = Protocol::home;
+    };
+
+    /**
+     * The socket of one endpoint within one listen thread. With more than one worker every worker binds its own socket
+     * to each endpoint and the kernel distributes the datagrams between them (SO_REUSEPORT).
+     */
+    struct Listener {
+        const Endpoint *endpoint = nullptr;
+        int socketDescriptor = -1;
+        bool wasBound = false;
+        bool paused = false; //Removed from epoll after a receive error until nextBindAttempt
+        std::chrono::steady_clock::time_point nextBindAttempt;
+        std::chrono::milliseconds rebindDelay{0};
+        uint32_t dropCount = 0; //Last SO_RXQ_OVFL value of the socket
+        uint32_t receiveBuffer = 0; //Bytes
+    };
+
+    static constexpr const char *anyAddress = "::";
+    static constexpr uint32_t maxWorkers = 8; //Plus the dispatch thread, keep maxThreadCounts in package.json in sync
+    static constexpr uint32_t maxQueueSize = 65536;
+    static constexpr uint32_t maxDuplicateTableSize = 1 << 20;
+    static constexpr uint32_t maxOutputBatchSize = 65536;
+    static constexpr uint32_t maxRateLimitedSenders = 1024;
+    static constexpr std::chrono::milliseconds minRebindDelay{10};
+    static constexpr std::chrono::milliseconds maxRebindDelay{5000};
+    static constexpr uint32_t maxSenderIpCacheSize = 1024;
+    static constexpr uint32_t maxReceiveBuffer = 1 << 20; //KiB
+    static constexpr uint32_t maxRefusalThreshold = 256;
+    static constexpr uint32_t refusalTableSize = 1024;
+    static constexpr uint32_t maxDispatchBatch = 64;
+    static constexpr std::chrono::seconds logLevelInterval{1};
+
     Flows::PNodeInfo _nodeInfo;
+    const InternedValues *_interned = nullptr;
     std::atomic_bool _stopListenThread{false};
-    std::thread _listenThread;
-    std::string _protocol;
+    int _stopEventDescriptor = -1;
+    std::vector<std::thread> _listenThreads;
+    std::vector<Endpoint> _endpoints;
+    PayloadType _payloadType = PayloadType::full;
+    uint32_t _workers = 1;
+    uint32_t _batchSize = 32;
+    uint32_t _batchTimeout = 0;
+    uint32_t _receiveBuffer = 0; //KiB, 0 keeps the system default
+    uint32_t _receiveBufferLimit = 0; //KiB, the buffer grows up to this size when the kernel drops datagrams. 0 disables growing.
+    Metrics _metrics{maxWorkers};
+    uint32_t _metricsInterval = 60;
+    uint32_t _duplicateWindow = 0; //Milliseconds, 0 disables duplicate suppression
+    uint32_t _duplicateTableSize = 4096;
+    AllowList _allowList;
+    uint32_t _rateLimit = 0; //Packets per second and sender, 0 disables rate limiting
+    uint32_t _rateBurst = 10;
+
+    //Only used by the dispatch thread
+    std::unordered_map<SenderKey, Flows::PVariable, SenderKey::Hash> _senderIpCache;
+    HomeColumns _homeColumns;
+    MultiColumns _multiColumns;
+    uint32_t _outputBatchSize = 1; //1 outputs every event on its own
+    uint32_t _outputBatchTimeout = 100;
+    Flows::PVariable _outputBatch;
+    std::chrono::steady_clock::time_point _outputBatchDeadline;
+    std::unique_ptr<RefusalCounter> _refusalCounter;
+    uint32_t _refusalWindow = 60; //Seconds
+    bool _suppressRefusals = false;
+    std::atomic<int32_t> _logLevel{3}; //Hex dumps are only built at level 4, see updateLogLevel()
+    std::vector<int64_t> _outputBatchReceiveTimes;
+    std::unique_ptr<CaptureFile> _capture;
+    std::mutex _captureMutex; //The listen threads append to the capture file
+
+    //Dispatch thread. Every listen thread hands its datagrams over through its own ring.
+    std::vector<std::unique_ptr<DatagramRing>> _rings;
+    OverflowPolicy _overflowPolicy = OverflowPolicy::dropOldest;
+    uint32_t _queueSize = 1024;
+    std::thread _dispatchThread;
+    std::atomic_bool _stopDispatchThread{false};
+    std::atomic_bool _dispatchWaiting{false};
+    std::mutex _dispatchMutex;
+    std::condition_variable _dispatchConditionVariable;
+    //Producers wait here while their ring is full and they must not drop datagrams
+    std::atomic<uint32_t> _spaceWaiters{0};
+    std::mutex _spaceMutex;
+    std::condition_variable _spaceConditionVariable;
 
-    int getSocketDescriptor(const std::string &listenAddress, uint16_t port);
-    void listen(const std::string &listenAddress, uint16_t port, PayloadType payloadType);
+    bool getEndpoint(std::string address, uint16_t port, const std::string &protocol, Endpoint &endpoint);
+    bool getEndpoints(const std::string &setting, std::vector<Endpoint> &endpoints);
+    int getSocketDescriptor(const std::string &listenAddress, uint16_t port, bool reusePort);
+    void signalStop();
+    bool waitForStopEvent(std::chrono::nanoseconds timeout);
+    void stopListenThreads();
+    SocketStore::Key getSocketKey(const Endpoint &endpoint, uint32_t worker);
+    void closeUnusedSockets(bool listening);
+    void listen(uint32_t worker);
+    uint32_t setReceiveBuffer(int socketDescriptor, uint32_t size);
+    void growReceiveBuffer(Listener &listener);
+    int32_t receiveBatch(int socketDescriptor, ReceiveBatch &batch, int &error);
+    void enqueueBatch(DatagramRing &ring, WorkerMetrics &metrics, Listener &listener, ReceiveBatch &batch, int32_t count, DuplicateFilter *duplicateFilter, RateLimiter *rateLimiter);
+    bool isAccepted(WorkerMetrics &metrics, const SenderKey &sender, std::string_view packet, int64_t time, DuplicateFilter *duplicateFilter, RateLimiter *rateLimiter);
+    void replay(const std::string &path, bool maxSpeed);
+    void updateLogLevel();
+    void wakeDispatchThread();
+    Datagram *waitForSpace(DatagramRing &ring);
+    void wakeProducers();
+    void dispatch();
 
-    void processRarePacket(const std::string &data, Flows::PVariable &var);
-    void processHomePacket(const std::string &data, Flows::PVariable &var);
-    void processMultiPacket(const std::string &data, Flows::PVariable &var);
+    void processDatagrams(const Datagram *datagrams, uint32_t count);
+    template<Protocol protocol>
+    void processRun(const Datagram *datagrams, uint32_t count);
+    template<Protocol protocol>
+    void processBatch(const Datagram *datagrams, uint32_t count);
+    template<Protocol protocol>
+    void decodeDatagram(const Datagram &datagram);
+    void processDatagram(const Datagram &datagram);
+    Flows::PVariable createMessage(const Datagram &datagram, int64_t &receiveTime);
+    void emitDecodedEvent(const Datagram &datagram, Protocol protocol, const Flows::PVariable &message, const Flows::PVariable &var, const Refusal &refusal, int64_t receiveTime);
+    void emitEvent(const Flows::PVariable &message, int64_t receiveTime);
+    void flushOutputBatch();
+    void recordOutputLatency(int64_t receiveTime);
+    bool correlateRefusal(const Datagram &datagram, Protocol protocol, const Refusal &refusal, int64_t receiveTime);
+    Flows::PVariable getSenderIp(const SenderKey &sender);
+    void outputMetrics();
+    Flows::PVariable getHistogramVariable(const LatencyHistogram &histogram);
+    bool processRarePacket(std::string_view data, Flows::PVariable &var);
+    bool processHomePacket(std::string_view data, Flows::PVariable &var, Refusal &refusal);
+    bool processMultiPacket(std::string_view data, Flows::PVariable &var, Refusal &refusal);
+    void addHomeFields(const HomePacket &packet, Flows::PVariable &var, Refusal &refusal);
+    void addMultiFields(const MultiPacket &packet, Flows::PVariable &var, Refusal &refusal);
 
-    void getFinger(const std::string &fingerId, std::string &finger, int32_t &iFinger);
+    void printParseError(ParseError error, std::string_view data);
+    static std::string stripPadding(std::string_view field);
 };
 
 }
@@ -0,0 +1,50 @@
+#include "InternedValues.h"
+
+namespace Ekey {
+
+const InternedValues &InternedValues::instance() {
+    static const InternedValues values;
+    return values;
+}
+
+InternedValues::InternedValues() {
+    for (int32_t value = minValue; value <= maxValue; value++) {
+        _integers[value - minValue] = std::make_shared<Flows::Variable>(value);
+    }
+    _fingerNames = buildTable(&PacketParser::getFingerName);
+    _homeActionNames = buildTable(&PacketParser::getHomeActionName);
+    _multiActionNames = buildTable(&PacketParser::getMultiActionName);
+    _relayNames = buildTable(&PacketParser::getRelayName);
+    _userStateNames = buildTable(&PacketParser::getUserStateName);
+    _keyNames = buildTable(&PacketParser::getKeyName);
+    _inputNames = buildTable(&PacketParser::getInputName);
+    for (auto protocol : {Protocol::rare, Protocol::home, Protocol::multi, Protocol::automatic}) {
+        _protocolNames[(size_t)protocol] = std::make_shared<Flows::Variable>(std::string(PacketParser::getProtocolName(protocol)));
+    }
+    _emptyString = std::make_shared<Flows::Variable>(std::string());
+}
+
+InternedValues::Table InternedValues::buildTable(std::string_view (*getName)(int32_t)) {
+    Table table;
+    for (int32_t value = minValue; value <= maxValue; value++) {
+        table[value - minValue] = std::make_shared<Flows::Variable>(std::string(getName(value)));
+    }
+    return table;
+}
+
+Flows::PVariable InternedValues::getInteger(int32_t value) const {
+    if (value < minValue || value > maxValue) return std::make_shared<Flows::Variable>(value);
+    return _integers[value - minValue];
+}
+
+Flows::PVariable InternedValues::getProtocolName(Protocol protocol) const {
+    if ((size_t)protocol >= _protocolNames.size()) return _emptyString;
+    return _protocolNames[(size_t)protocol];
+}
+
+Flows::PVariable InternedValues::lookup(const Table &table, int32_t value) const {
+    if (value < minValue || value > maxValue) return _emptyString;
+    return table[value - minValue];
+}
+
+}
\ No newline at end of file
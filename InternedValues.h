@@ -0,0 +1,83 @@
+#ifndef EKEY_INTERNEDVALUES_H_
+#define EKEY_INTERNEDVALUES_H_
+
+#include <homegear-node/Variable.h>
+#include "PacketParser.h"
+#include <array>
+#include <string>
+#include <string_view>
+
+namespace Ekey {
+
+/**
+ * Immutable variables for all values of the enumerated packet fields. The table is built once when the first node is
+ * initialized and the decoders share these pointers instead of allocating a new variable per packet. The returned
+ * variables are shared between all messages and must never be modified.
+ */
+class InternedValues {
+public:
+    static const InternedValues &instance();
+
+    //Struct keys
+    const std::string senderIpKey{"senderIp"};
+    const std::string protocolKey{"protocol"};
+    const std::string senderPortKey{"senderPort"};
+    const std::string receiveTimeKey{"receiveTime"};
+    const std::string dispatchTimeKey{"dispatchTime"};
+    const std::string payloadKey{"payload"};
+    const std::string versionKey{"version"};
+    const std::string commandKey{"command"};
+    const std::string terminalIdKey{"terminalId"};
+    const std::string eventKey{"event"};
+    const std::string timeKey{"time"};
+    const std::string nameKey{"name"};
+    const std::string personalIdKey{"personalId"};
+    const std::string packetTypeKey{"packetType"};
+    const std::string userIdKey{"userId"};
+    const std::string userNameKey{"username"};
+    const std::string userStateKey{"userState"};
+    const std::string fingerIdKey{"fingerId"};
+    const std::string fingerKey{"finger"};
+    const std::string keyKey{"key"};
+    const std::string keyIdKey{"keyId"};
+    const std::string serialNrKey{"serialNr"};
+    const std::string readerNameKey{"readerName"};
+    const std::string actionKey{"action"};
+    const std::string inputKey{"input"};
+    const std::string inputIdKey{"inputId"};
+    const std::string relaysIdKey{"relaysId"};
+    const std::string relayKey{"relay"};
+
+    Flows::PVariable getInteger(int32_t value) const;
+    Flows::PVariable getProtocolName(Protocol protocol) const;
+    Flows::PVariable getFingerName(int32_t fingerId) const { return lookup(_fingerNames, fingerId); }
+    Flows::PVariable getHomeActionName(int32_t action) const { return lookup(_homeActionNames, action); }
+    Flows::PVariable getMultiActionName(int32_t action) const { return lookup(_multiActionNames, action); }
+    Flows::PVariable getRelayName(int32_t relayId) const { return lookup(_relayNames, relayId); }
+    Flows::PVariable getUserStateName(int32_t userState) const { return lookup(_userStateNames, userState); }
+    Flows::PVariable getKeyName(int32_t keyId) const { return lookup(_keyNames, keyId); }
+    Flows::PVariable getInputName(int32_t inputId) const { return lookup(_inputNames, inputId); }
+private:
+    //All enumerated fields decode to values between -2 ("-") and 15 (one hex digit)
+    static constexpr int32_t minValue = -2;
+    static constexpr int32_t maxValue = 15;
+    typedef std::array<Flows::PVariable, maxValue - minValue + 1> Table;
+
+    Table _integers;
+    Table _fingerNames;
+    Table _homeActionNames;
+    Table _multiActionNames;
+    Table _relayNames;
+    Table _userStateNames;
+    Table _keyNames;
+    Table _inputNames;
+    std::array<Flows::PVariable, 4> _protocolNames;
+    Flows::PVariable _emptyString;
+
+    InternedValues();
+    static Table buildTable(std::string_view (*getName)(int32_t));
+    Flows::PVariable lookup(const Table &table, int32_t value) const;
+};
+
+}
+#endif
\ No newline at end of file
@@ -0,0 +1,121 @@
+#include "Metrics.h"
+
+namespace Ekey {
+
+uint32_t LatencyHistogram::getIndex(uint64_t value) {
+    if (value < subBuckets) return (uint32_t)value;
+    uint32_t exponent = 63 - (uint32_t)__builtin_clzll(value);
+    if (exponent > maxExponent) return bucketCount - 1;
+    //The bits following the leading one select the sub bucket
+    uint32_t subBucket = (uint32_t)(value >> (exponent - subBucketBits)) & (subBuckets - 1);
+    return subBuckets + (exponent - subBucketBits) * subBuckets + subBucket;
+}
+
+uint64_t LatencyHistogram::getUpperBound(uint32_t index) {
+    if (index < subBuckets) return index;
+    uint32_t exponent = (index - subBuckets) / subBuckets + subBucketBits;
+    uint64_t subBucket = (index - subBuckets) % subBuckets;
+    return ((subBuckets + subBucket + 1) << (exponent - subBucketBits)) - 1;
+}
+
+void LatencyHistogram::record(uint64_t value) {
+    _buckets[getIndex(value)].fetch_add(1, std::memory_order_relaxed);
+    uint64_t max = _max.load(std::memory_order_relaxed);
+    while (value > max && !_max.compare_exchange_weak(max, value, std::memory_order_relaxed));
+}
+
+void LatencyHistogram::reset() {
+    for (auto &bucket : _buckets) {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+    _max.store(0, std::memory_order_relaxed);
+}
+
+void LatencyHistogram::add(const LatencyHistogram &other) {
+    for (uint32_t i = 0; i < bucketCount; i++) {
+        _buckets[i].fetch_add(other._buckets[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+    }
+    uint64_t otherMax = other.max();
+    uint64_t max = _max.load(std::memory_order_relaxed);
+    while (otherMax > max && !_max.compare_exchange_weak(max, otherMax, std::memory_order_relaxed));
+}
+
+uint64_t LatencyHistogram::count() const {
+    uint64_t count = 0;
+    for (auto &bucket : _buckets) {
+        count += bucket.load(std::memory_order_relaxed);
+    }
+    return count;
+}
+
+uint64_t LatencyHistogram::getValueAtQuantile(double quantile) const {
+    uint64_t total = count();
+    if (total == 0) return 0;
+    auto target = (uint64_t)(quantile * total);
+    if (target < 1) target = 1;
+    uint64_t count = 0;
+    for (uint32_t i = 0; i < bucketCount; i++) {
+        count += _buckets[i].load(std::memory_order_relaxed);
+        if (count >= target) {
+            if (i == bucketCount - 1) return max();
+            uint64_t upperBound = getUpperBound(i);
+            return upperBound < max() ? upperBound : max();
+        }
+    }
+    return max();
+}
+
+void Metrics::countParseError(ParseError error) {
+    switch (error) {
+        case ParseError::none:
+            break;
+        case ParseError::lengthMismatch:
+            increment(lengthMismatches);
+            break;
+        case ParseError::badDigit:
+            increment(badDigits);
+            break;
+        case ParseError::badSeparator:
+            increment(badSeparators);
+            break;
+        case ParseError::badTerminalAddress:
+            increment(badTerminalAddresses);
+            break;
+    }
+}
+
+void WorkerMetrics::reset() {
+    for (auto *counter : {&receivedBatches, &receivedDatagrams, &receivedBytes, &enqueuedDatagrams, &queueOverflows, &duplicates, &rejectedSenders, &rateLimited, &oversizedDatagrams, &kernelDrops, &receiveErrors, &socketErrors, &rebinds}) {
+        counter->store(0, std::memory_order_relaxed);
+    }
+    socketLatency.reset();
+}
+
+uint64_t Metrics::sum(std::atomic<uint64_t> WorkerMetrics::*counter) const {
+    uint64_t sum = 0;
+    for (uint32_t i = 0; i < workerCount; i++) {
+        sum += (workers[i].*counter).load(std::memory_order_relaxed);
+    }
+    return sum;
+}
+
+void Metrics::getSocketLatency(LatencyHistogram &histogram) const {
+    for (uint32_t i = 0; i < workerCount; i++) {
+        histogram.add(workers[i].socketLatency);
+    }
+}
+
+void Metrics::reset() {
+    for (auto *counter : {&dispatchedDatagrams, &emittedEvents, &outputMessages, &refusalAlarms, &suppressedRefusals, &lengthMismatches, &badDigits, &badSeparators, &badTerminalAddresses, &unknownProtocols}) {
+        counter->store(0, std::memory_order_relaxed);
+    }
+    for (auto &histogram : decodeLatency) {
+        histogram.reset();
+    }
+    outputLatency.reset();
+    for (uint32_t i = 0; i < workerCount; i++) {
+        workers[i].reset();
+    }
+}
+
+}
\ No newline at end of file
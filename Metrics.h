@@ -0,0 +1,115 @@
+#ifndef EKEY_METRICS_H_
+#define EKEY_METRICS_H_
+
+#include "PacketParser.h"
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+namespace Ekey {
+
+/**
+ * Log-linear (HDR style) histogram of nanosecond values. Every power of two is split into 16 buckets, so a reported
+ * value is at most 1/16 above the recorded one. Recording is a single relaxed increment and safe from any thread.
+ */
+class LatencyHistogram {
+public:
+    void record(uint64_t value);
+    void reset();
+    /**
+     * Adds the recorded values of other, e. g. to merge the histograms of several threads for output.
+     */
+    void add(const LatencyHistogram &other);
+
+    uint64_t count() const;
+    uint64_t max() const { return _max.load(std::memory_order_relaxed); }
+    /**
+     * @param quantile Between 0 and 1, e. g. 0.99.
+     * @return The upper bound of the bucket containing the quantile.
+     */
+    uint64_t getValueAtQuantile(double quantile) const;
+private:
+    static constexpr uint32_t subBucketBits = 4;
+    static constexpr uint32_t subBuckets = 1 << subBucketBits;
+    static constexpr uint32_t maxExponent = 40; //About 18 minutes, larger values are recorded in the last bucket
+    static constexpr uint32_t bucketCount = subBuckets + (maxExponent - subBucketBits + 1) * subBuckets;
+
+    std::array<std::atomic<uint64_t>, bucketCount> _buckets{};
+    std::atomic<uint64_t> _max{0};
+
+    static uint32_t getIndex(uint64_t value);
+    static uint64_t getUpperBound(uint32_t index);
+};
+
+/**
+ * Counters of one listen thread. Every listen thread only writes its own block, which starts on its own cache line, so
+ * the threads do not invalidate each other's cache lines on every datagram. The blocks are summed up on output.
+ */
+struct alignas(64) WorkerMetrics {
+    std::atomic<uint64_t> receivedBatches{0};
+    std::atomic<uint64_t> receivedDatagrams{0};
+    std::atomic<uint64_t> receivedBytes{0};
+    std::atomic<uint64_t> enqueuedDatagrams{0};
+
+    //Drop reasons
+    std::atomic<uint64_t> queueOverflows{0};
+    std::atomic<uint64_t> duplicates{0};
+    std::atomic<uint64_t> rejectedSenders{0};
+    std::atomic<uint64_t> rateLimited{0};
+    std::atomic<uint64_t> oversizedDatagrams{0};
+    std::atomic<uint64_t> kernelDrops{0};
+    std::atomic<uint64_t> receiveErrors{0};
+    std::atomic<uint64_t> socketErrors{0};
+    std::atomic<uint64_t> rebinds{0};
+
+    //From the kernel receive timestamp to the listen thread
+    LatencyHistogram socketLatency;
+
+    void reset();
+};
+
+/**
+ * Counters of one node. All counters are updated with relaxed atomics on the hot path and read without
+ * synchronization when the metrics are emitted. The counters below are written by the dispatch thread only, the listen
+ * threads count in their WorkerMetrics.
+ */
+struct Metrics {
+    explicit Metrics(uint32_t workerCount) : workers(new WorkerMetrics[workerCount]), workerCount(workerCount) {}
+
+    std::atomic<uint64_t> dispatchedDatagrams{0};
+    std::atomic<uint64_t> emittedEvents{0};
+    std::atomic<uint64_t> outputMessages{0};
+    std::atomic<uint64_t> refusalAlarms{0};
+    std::atomic<uint64_t> suppressedRefusals{0};
+
+    //Drop reasons
+    std::atomic<uint64_t> lengthMismatches{0};
+    std::atomic<uint64_t> badDigits{0};
+    std::atomic<uint64_t> badSeparators{0};
+    std::atomic<uint64_t> badTerminalAddresses{0};
+    std::atomic<uint64_t> unknownProtocols{0};
+
+    //Indexed by Protocol
+    std::array<LatencyHistogram, 3> decodeLatency;
+    //From the kernel receive timestamp to the output of the event
+    LatencyHistogram outputLatency;
+
+    //Indexed by listen thread, a replay counts in the first one
+    std::unique_ptr<WorkerMetrics[]> workers;
+    uint32_t workerCount = 0;
+
+    static void increment(std::atomic<uint64_t> &counter, uint64_t value = 1) { counter.fetch_add(value, std::memory_order_relaxed); }
+    void countParseError(ParseError error);
+    LatencyHistogram &getDecodeLatency(Protocol protocol) { return decodeLatency[(size_t)protocol]; }
+    WorkerMetrics &getWorker(uint32_t worker) { return workers[worker]; }
+    /**
+     * @return The sum of counter over all listen threads.
+     */
+    uint64_t sum(std::atomic<uint64_t> WorkerMetrics::*counter) const;
+    void getSocketLatency(LatencyHistogram &histogram) const;
+    void reset();
+};
+
+}
+#endif
\ No newline at end of file
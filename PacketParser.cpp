@@ -0,0 +1,335 @@
+#include "PacketParser.h"
+
+#include <array>
+#include <charconv>
+#include <cstdio>
+#include <cstring>
+
+namespace Ekey {
+
+namespace {
+
+constexpr std::array<std::string_view, 10> fingerNames{
+    "Right Hand Pinky",
+    "Left Hand Pinky",
+    "Left Hand Ring Finger",
+    "Left Hand Middle Finger",
+    "Left Hand Index Finger",
+    "Left Hand Thumb",
+    "Right Hand Thumb",
+    "Right Hand Index Finger",
+    "Right Hand Middle Finger",
+    "Right Hand Ring Finger"
+};
+
+constexpr std::array<std::string_view, 16> multiActionNames{
+    "",
+    "open",
+    "refuse unknown finger",
+    "refuse time slot A",
+    "refuse time slot B",
+    "refuse disabled",
+    "refuse \"Only always users\"",
+    "scanner not connected to control panel",
+    "digital input",
+    "",
+    "codepad 1 min. lock",
+    "codepad 15 min. lock",
+    "",
+    "",
+    "",
+    ""
+};
+
+constexpr std::array<std::string_view, 10> relayNames{"Relays0", "Relays1", "Relays2", "Relays3", "Relays4", "Relays5", "Relays6", "Relays7", "Relays8", "Relays9"};
+constexpr std::array<std::string_view, 10> keyNames{"Key 0", "Key 1", "Key 2", "Key 3", "Key 4", "Key 5", "Key 6", "Key 7", "Key 8", "Key 9"};
+constexpr std::array<std::string_view, 10> inputNames{"Input 0", "Input 1", "Input 2", "Input 3", "Input 4", "Input 5", "Input 6", "Input 7", "Input 8", "Input 9"};
+
+inline bool isDigit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+inline std::string_view view(std::string_view data, Field field) {
+    return data.substr(field.offset, field.length);
+}
+
+}
+
+bool PacketParser::getProtocol(std::string_view name, Protocol &protocol) {
+    if (name == "rare") protocol = Protocol::rare;
+    else if (name == "home") protocol = Protocol::home;
+    else if (name == "multi") protocol = Protocol::multi;
+    else if (name == "auto") protocol = Protocol::automatic;
+    else return false;
+    return true;
+}
+
+std::string_view PacketParser::getProtocolName(Protocol protocol) {
+    switch (protocol) {
+        case Protocol::rare:
+            return "rare";
+        case Protocol::home:
+            return "home";
+        case Protocol::multi:
+            return "multi";
+        case Protocol::automatic:
+            return "auto";
+    }
+    return "";
+}
+
+bool PacketParser::detectProtocol(std::string_view data, Protocol &protocol) {
+    switch (data.size()) {
+        case HomeLayout::size:
+            for (auto field : HomeLayout::separatedFields) {
+                if (data[field.offset + field.length] != '_') return false;
+            }
+            protocol = Protocol::home;
+            return true;
+        case MultiLayout::size:
+            //Packet type and user ID are digits, in HOME packets the second character is an underscore
+            if (!isDigit(data[MultiLayout::packetType.offset]) || !isDigit(data[MultiLayout::userId.offset])) return false;
+            protocol = Protocol::multi;
+            return true;
+        case RareLayout::size:
+            //Binary, the length is all there is to check
+            protocol = Protocol::rare;
+            return true;
+        default:
+            return false;
+    }
+}
+
+bool PacketParser::decodeNumber(std::string_view data, Field field, int32_t &value, int base) {
+    //Parse as unsigned so a sign is rejected like any other non digit character
+    uint32_t result = 0;
+    const char *begin = data.data() + field.offset;
+    const char *end = begin + field.length;
+    auto decoded = std::from_chars(begin, end, result, base);
+    if (decoded.ec != std::errc() || decoded.ptr != end) return false;
+    value = (int32_t)result;
+    return true;
+}
+
+bool PacketParser::decodeFinger(char fingerId, int32_t &value) {
+    if (fingerId == 'R') value = fingerRfid;
+    else if (fingerId == '-') value = fingerNone;
+    else if (isDigit(fingerId)) value = fingerId - '0';
+    else return false;
+    return true;
+}
+
+uint32_t PacketParser::load32(std::string_view data, Field field) {
+    uint32_t value;
+    std::memcpy(&value, data.data() + field.offset, sizeof(value));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    value = __builtin_bswap32(value);
+#endif
+    return value;
+}
+
+uint16_t PacketParser::load16(std::string_view data, Field field) {
+    uint16_t value;
+    std::memcpy(&value, data.data() + field.offset, sizeof(value));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    value = __builtin_bswap16(value);
+#endif
+    return value;
+}
+
+std::string_view PacketParser::loadString(std::string_view data, Field field) {
+    //Character arrays are zero terminated unless they use the whole field
+    auto result = view(data, field);
+    auto end = result.find('\0');
+    if (end != std::string_view::npos) result = result.substr(0, end);
+    return result;
+}
+
+ParseError PacketParser::parseRare(std::string_view data, RarePacket &packet) {
+    if (data.size() != RareLayout::size) return ParseError::lengthMismatch;
+
+    packet.version = load32(data, RareLayout::version);
+    packet.command = load32(data, RareLayout::command);
+    if (packet.command == RareLayout::commandOpen) packet.action = 1;
+    else if (packet.command == RareLayout::commandRefuse) packet.action = 2;
+    else packet.action = 0;
+
+    //Address = ((yy * 53 + ww) * 65536) + ssss + 0x70000000
+    packet.terminalId = load32(data, RareLayout::terminalId);
+    if (packet.terminalId >= RareLayout::terminalAddressBase) {
+        uint32_t address = packet.terminalId - RareLayout::terminalAddressBase;
+        packet.sequenceNumber = address & 0xFFFF;
+        packet.productionWeek = (address >> 16) % 53;
+        packet.productionYear = (address >> 16) / 53;
+        //Larger values do not fit into the eight digits of the serial number and would map two scanners to the same one
+        if (packet.sequenceNumber > RareLayout::maxSequenceNumber || packet.productionYear > RareLayout::maxProductionYear) return ParseError::badTerminalAddress;
+    } else {
+        packet.sequenceNumber = 0;
+        packet.productionWeek = 0;
+        packet.productionYear = 0;
+    }
+    packet.terminalSerial = loadString(data, RareLayout::terminalSerial);
+
+    uint8_t relayId = (uint8_t)data[RareLayout::relayId.offset];
+    if (relayId == RareLayout::relayDouble) packet.relayId = relayMultiple;
+    else if (relayId < 9) packet.relayId = relayId + 1;
+    else packet.relayId = relayNone;
+
+    packet.userId = (int32_t)load32(data, RareLayout::userId);
+
+    //RARE counts fingers from 0, HOME uses the digit printed on the control unit
+    uint32_t finger = load32(data, RareLayout::finger);
+    if (finger == RareLayout::fingerRfid) packet.fingerId = fingerRfid;
+    else if (finger <= 9) packet.fingerId = (int32_t)((finger + 1) % 10);
+    else packet.fingerId = fingerNone;
+
+    packet.event = loadString(data, RareLayout::event);
+    packet.time = loadString(data, RareLayout::time);
+    packet.name = load16(data, RareLayout::name);
+    packet.personalId = load16(data, RareLayout::personalId);
+
+    return ParseError::none;
+}
+
+ParseError PacketParser::parseHome(std::string_view data, HomePacket &packet) {
+    if (data.size() != HomeLayout::size) return ParseError::lengthMismatch;
+
+    if (!decodeNumber(data, HomeLayout::packetType, packet.packetType)) return ParseError::badDigit;
+    if (!decodeNumber(data, HomeLayout::userId, packet.userId)) return ParseError::badDigit;
+    if (!decodeFinger(data[HomeLayout::fingerId.offset], packet.fingerId)) return ParseError::badDigit;
+    packet.serialNr = view(data, HomeLayout::serialNr);
+    if (!decodeNumber(data, HomeLayout::action, packet.action)) return ParseError::badDigit;
+
+    char relayId = data[HomeLayout::relayId.offset];
+    if (relayId == 'd') packet.relayId = relayMultiple;
+    else if (relayId == '-') packet.relayId = relayNone;
+    else if (isDigit(relayId)) packet.relayId = relayId - '0';
+    else return ParseError::badDigit;
+
+    for (auto field : HomeLayout::separatedFields) {
+        if (data[field.offset + field.length] != '_') return ParseError::badSeparator;
+    }
+
+    return ParseError::none;
+}
+
+ParseError PacketParser::parseMulti(std::string_view data, MultiPacket &packet) {
+    if (data.size() != MultiLayout::size) return ParseError::lengthMismatch;
+
+    if (!decodeNumber(data, MultiLayout::packetType, packet.packetType)) return ParseError::badDigit;
+    if (!decodeNumber(data, MultiLayout::userId, packet.userId)) return ParseError::badDigit;
+    packet.userName = view(data, MultiLayout::userName);
+
+    char userState = data[MultiLayout::userState.offset];
+    if (userState == '-') packet.userState = userStateUndefined;
+    else if (isDigit(userState)) packet.userState = userState - '0';
+    else return ParseError::badDigit;
+
+    if (!decodeFinger(data[MultiLayout::fingerId.offset], packet.fingerId)) return ParseError::badDigit;
+
+    char keyId = data[MultiLayout::keyId.offset];
+    if (keyId == '-') packet.keyId = keyMain;
+    else if (isDigit(keyId)) packet.keyId = keyId - '0';
+    else return ParseError::badDigit;
+
+    packet.serialNr = view(data, MultiLayout::serialNr);
+    packet.readerName = view(data, MultiLayout::readerName);
+    if (!decodeNumber(data, MultiLayout::action, packet.action, 16)) return ParseError::badDigit;
+
+    char inputId = data[MultiLayout::inputId.offset];
+    if (inputId == '-') packet.inputId = inputNone;
+    else if (isDigit(inputId)) packet.inputId = inputId - '0';
+    else return ParseError::badDigit;
+
+    return ParseError::none;
+}
+
+int64_t PacketParser::getSerialNumber(std::string_view serialNr) {
+    uint64_t value = 0;
+    auto decoded = std::from_chars(serialNr.data(), serialNr.data() + serialNr.size(), value);
+    if (serialNr.empty() || decoded.ec != std::errc() || decoded.ptr != serialNr.data() + serialNr.size() || value > (uint64_t)INT64_MAX) return -1;
+    return (int64_t)value;
+}
+
+std::string PacketParser::getSerialNr(const RarePacket &packet) {
+    if (!packet.terminalSerial.empty()) return std::string(packet.terminalSerial);
+    //parseRare() limits the year to two and the sequence number to four digits
+    std::array<char, 16> serialNr{};
+    snprintf(serialNr.data(), serialNr.size(), "%02u%02u%04u", packet.productionWeek, packet.productionYear, packet.sequenceNumber);
+    return serialNr.data();
+}
+
+int64_t PacketParser::getSerialNumber(const RarePacket &packet) {
+    return getSerialNumber(getSerialNr(packet));
+}
+
+bool PacketParser::isRefusal(const HomePacket &packet) {
+    return packet.action == 2;
+}
+
+bool PacketParser::isRefusal(const MultiPacket &packet) {
+    //Unknown finger, time slot A or B, user disabled and "Only always users"
+    return packet.action >= 2 && packet.action <= 6;
+}
+
+std::string_view PacketParser::getErrorString(ParseError error) {
+    switch (error) {
+        case ParseError::none:
+            return "no error";
+        case ParseError::lengthMismatch:
+            return "length mismatch";
+        case ParseError::badDigit:
+            return "invalid digit";
+        case ParseError::badSeparator:
+            return "invalid separator";
+        case ParseError::badTerminalAddress:
+            return "invalid terminal address";
+    }
+    return "unknown error";
+}
+
+std::string_view PacketParser::getFingerName(int32_t fingerId) {
+    if (fingerId == fingerRfid) return "RFID";
+    if (fingerId == fingerNone) return "Unknown Finger";
+    if (fingerId < 0 || fingerId >= (int32_t)fingerNames.size()) return "";
+    return fingerNames[fingerId];
+}
+
+std::string_view PacketParser::getHomeActionName(int32_t action) {
+    if (action == 1) return "open";
+    if (action == 2) return "refuse";
+    return "";
+}
+
+std::string_view PacketParser::getMultiActionName(int32_t action) {
+    if (action < 0 || action >= (int32_t)multiActionNames.size()) return "";
+    return multiActionNames[action];
+}
+
+std::string_view PacketParser::getRelayName(int32_t relayId) {
+    if (relayId == relayMultiple) return "Multiple Relays";
+    if (relayId == relayNone) return "none";
+    if (relayId < 0 || relayId >= (int32_t)relayNames.size()) return "";
+    return relayNames[relayId];
+}
+
+std::string_view PacketParser::getUserStateName(int32_t userState) {
+    if (userState == userStateUndefined) return "undefined";
+    if (userState == 0) return "user inactive";
+    if (userState == 1) return "user active";
+    return "";
+}
+
+std::string_view PacketParser::getKeyName(int32_t keyId) {
+    if (keyId == keyMain) return "Mainkey";
+    if (keyId < 0 || keyId >= (int32_t)keyNames.size()) return "";
+    return keyNames[keyId];
+}
+
+std::string_view PacketParser::getInputName(int32_t inputId) {
+    if (inputId == inputNone) return "no digital input";
+    if (inputId < 0 || inputId >= (int32_t)inputNames.size()) return "";
+    return inputNames[inputId];
+}
+
+}
@@ -0,0 +1,209 @@
+#ifndef EKEY_PACKETPARSER_H_
+#define EKEY_PACKETPARSER_H_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace Ekey {
+
+enum class Protocol : int32_t {
+    rare,
+    home,
+    multi,
+    automatic //Detected per packet, see PacketParser::detectProtocol()
+};
+
+enum class ParseError : int32_t {
+    none = 0,
+    lengthMismatch,
+    badDigit,
+    badSeparator,
+    badTerminalAddress
+};
+
+struct Field {
+    uint8_t offset;
+    uint8_t length;
+};
+
+//Special field values shared by the HOME and MULTI formats. A "-" in a field always decodes to -2.
+constexpr int32_t fingerRfid = -1;
+constexpr int32_t fingerNone = -2;
+constexpr int32_t relayMultiple = -1;
+constexpr int32_t relayNone = -2;
+constexpr int32_t userStateUndefined = -2;
+constexpr int32_t keyMain = -2;
+constexpr int32_t inputNone = -2;
+
+namespace RareLayout {
+    //Binary, all numbers are little endian
+    constexpr size_t size = 72;
+    constexpr Field version{0, 4};
+    constexpr Field command{4, 4};
+    constexpr Field terminalId{8, 4};
+    constexpr Field terminalSerial{12, 14};
+    constexpr Field relayId{26, 1};
+    constexpr Field reserved{27, 1};
+    constexpr Field userId{28, 4};
+    constexpr Field finger{32, 4};
+    constexpr Field event{36, 16};
+    constexpr Field time{52, 16};
+    constexpr Field name{68, 2};
+    constexpr Field personalId{70, 2};
+
+    constexpr bool follows(Field previous, Field next) { return previous.offset + previous.length == next.offset; }
+    static_assert(version.offset == 0 && follows(version, command) && follows(command, terminalId) && follows(terminalId, terminalSerial) &&
+                  follows(terminalSerial, relayId) && follows(relayId, reserved) && follows(reserved, userId) && follows(userId, finger) &&
+                  follows(finger, event) && follows(event, time) && follows(time, name) && follows(name, personalId) &&
+                  personalId.offset + personalId.length == size, "RARE fields have to be packed without gaps");
+
+    constexpr uint32_t commandOpen = 0x88;
+    constexpr uint32_t commandRefuse = 0x89;
+    constexpr uint32_t relayDouble = 15;
+    constexpr uint32_t fingerRfid = 13;
+    constexpr uint32_t terminalAddressBase = 0x70000000;
+    //The serial number holds the year with two digits and the sequence number with four
+    constexpr uint32_t maxProductionYear = 99;
+    constexpr uint32_t maxSequenceNumber = 9999;
+}
+
+namespace HomeLayout {
+    //1_0046_4_80156809150025_1_2
+    constexpr size_t size = 27;
+    constexpr Field packetType{0, 1};
+    constexpr Field userId{2, 4};
+    constexpr Field fingerId{7, 1};
+    constexpr Field serialNr{9, 14};
+    constexpr Field action{24, 1};
+    constexpr Field relayId{26, 1};
+
+    //Every field is followed by an underscore
+    constexpr std::array<Field, 5> separatedFields{packetType, userId, fingerId, serialNr, action};
+}
+
+namespace MultiLayout {
+    //10003JOSEF----17280156809150025GAR-1-
+    constexpr size_t size = 37;
+    constexpr Field packetType{0, 1};
+    constexpr Field userId{1, 4};
+    constexpr Field userName{5, 9};
+    constexpr Field userState{14, 1};
+    constexpr Field fingerId{15, 1};
+    constexpr Field keyId{16, 1};
+    constexpr Field serialNr{17, 14};
+    constexpr Field readerName{31, 4};
+    constexpr Field action{35, 1};
+    constexpr Field inputId{36, 1};
+}
+
+/**
+ * A decoded RARE packet. Relay, finger and action are mapped to the codes of the HOME format. The terminal address is
+ * reversed into production week, production year and sequence number of the scanner's serial number.
+ */
+struct RarePacket {
+    uint32_t version = 0;
+    uint32_t command = 0;
+    uint32_t terminalId = 0;
+    uint32_t productionWeek = 0;
+    uint32_t productionYear = 0;
+    uint32_t sequenceNumber = 0;
+    std::string_view terminalSerial;
+    int32_t relayId = relayNone;
+    int32_t userId = 0;
+    int32_t fingerId = fingerNone;
+    int32_t action = 0;
+    std::string_view event;
+    std::string_view time;
+    uint16_t name = 0;
+    uint16_t personalId = 0;
+};
+
+struct HomePacket {
+    int32_t packetType = 0;
+    int32_t userId = 0;
+    int32_t fingerId = fingerNone;
+    std::string_view serialNr;
+    int32_t action = 0;
+    int32_t relayId = relayNone;
+};
+
+/**
+ * A decoded MULTI packet. The string views point into the parsed datagram and still contain the "-" padding of the
+ * converter.
+ */
+struct MultiPacket {
+    int32_t packetType = 0;
+    int32_t userId = 0;
+    std::string_view userName;
+    int32_t userState = userStateUndefined;
+    int32_t fingerId = fingerNone;
+    int32_t keyId = keyMain;
+    std::string_view serialNr;
+    std::string_view readerName;
+    int32_t action = 0;
+    int32_t inputId = inputNone;
+};
+
+/**
+ * Allocation free decoder for the ASCII packet formats of the ekey udp converter. Nothing is copied, string fields are
+ * returned as views into the datagram.
+ */
+class PacketParser {
+public:
+    static bool getProtocol(std::string_view name, Protocol &protocol);
+    static std::string_view getProtocolName(Protocol protocol);
+
+    /**
+     * Classifies a datagram by its length and a few characters at fixed positions. The three formats have different
+     * lengths, the characters only make sure that a datagram of the right length is not garbage.
+     *
+     * @return false if the datagram does not look like any of the formats.
+     */
+    static bool detectProtocol(std::string_view data, Protocol &protocol);
+
+    static ParseError parseRare(std::string_view data, RarePacket &packet);
+    static ParseError parseHome(std::string_view data, HomePacket &packet);
+    static ParseError parseMulti(std::string_view data, MultiPacket &packet);
+
+    /**
+     * Returns the serial number of the scanner of a RARE packet. Older converters leave the serial number field empty,
+     * then the eight digits encoded in the terminal address are used: week, year and sequence number ("wwyyssss"). This
+     * is shorter than the 14 digits of HOME and MULTI packets, which the address does not contain.
+     */
+    static std::string getSerialNr(const RarePacket &packet);
+
+    /**
+     * Converts a serial number to an integer, e. g. for compact output. RARE packets use getSerialNr().
+     *
+     * @return -1 if the serial number contains anything but digits.
+     */
+    static int64_t getSerialNumber(std::string_view serialNr);
+    static int64_t getSerialNumber(const RarePacket &packet);
+
+    /**
+     * @return true if the scanner refused access, e. g. because of an unknown finger or outside of a time slot.
+     */
+    static bool isRefusal(const HomePacket &packet);
+    static bool isRefusal(const MultiPacket &packet);
+
+    static std::string_view getErrorString(ParseError error);
+    static std::string_view getFingerName(int32_t fingerId);
+    static std::string_view getHomeActionName(int32_t action);
+    static std::string_view getMultiActionName(int32_t action);
+    static std::string_view getRelayName(int32_t relayId);
+    static std::string_view getUserStateName(int32_t userState);
+    static std::string_view getKeyName(int32_t keyId);
+    static std::string_view getInputName(int32_t inputId);
+private:
+    static bool decodeNumber(std::string_view data, Field field, int32_t &value, int base = 10);
+    static bool decodeFinger(char fingerId, int32_t &value);
+    static uint32_t load32(std::string_view data, Field field);
+    static uint16_t load16(std::string_view data, Field field);
+    static std::string_view loadString(std::string_view data, Field field);
+};
+
+}
+#endif
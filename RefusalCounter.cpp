@@ -0,0 +1,62 @@
+#include "RefusalCounter.h"
+
+namespace Ekey {
+
+namespace {
+
+inline uint64_t mix(uint64_t value) {
+    //Finalizer of MurmurHash3, serial numbers of one site often only differ in their last digits
+    value ^= value >> 33;
+    value *= 0xff51afd7ed558ccdULL;
+    value ^= value >> 33;
+    value *= 0xc4ceb9fe1a85ec53ULL;
+    value ^= value >> 33;
+    return value;
+}
+
+}
+
+RefusalCounter::RefusalCounter(uint32_t capacity, uint32_t threshold, int64_t window) : _threshold(threshold > 0 ? threshold : 1), _window(window) {
+    uint32_t size = maxProbes;
+    while (size < capacity) size <<= 1;
+    _mask = size - 1;
+    _entries.reset(new Entry[size]);
+    _times.reset(new int64_t[(size_t)size * _threshold]());
+}
+
+bool RefusalCounter::add(uint64_t scanner, int64_t now, int64_t &firstRefusal) {
+    uint64_t hash = mix(scanner);
+    Entry *entry = nullptr;
+    Entry *replace = nullptr;
+    for (uint32_t i = 0; i < maxProbes; i++) {
+        Entry &candidate = _entries[(hash + i) & _mask];
+        if (candidate.last != 0 && candidate.scanner == scanner) {
+            entry = &candidate;
+            break;
+        }
+        if (!replace || candidate.last < replace->last) replace = &candidate;
+    }
+    if (!entry) {
+        entry = replace;
+        entry->scanner = scanner;
+        entry->count = 0;
+        entry->next = 0;
+    }
+
+    int64_t *times = &_times[(size_t)(entry - _entries.get()) * _threshold];
+    times[entry->next] = now;
+    entry->next = entry->next + 1 < _threshold ? entry->next + 1 : 0;
+    if (entry->count < _threshold) entry->count++;
+    entry->last = now;
+    if (entry->count < _threshold) return false;
+
+    //The ring is full, so the next slot holds the oldest refusal
+    int64_t oldest = times[entry->next];
+    if (now - oldest >= _window) return false;
+    firstRefusal = oldest;
+    entry->count = 0;
+    entry->next = 0;
+    return true;
+}
+
+}
@@ -0,0 +1,54 @@
+#ifndef EKEY_REFUSALCOUNTER_H_
+#define EKEY_REFUSALCOUNTER_H_
+
+#include <cstdint>
+#include <memory>
+
+namespace Ekey {
+
+/**
+ * Counts refused accesses per scanner in a sliding time window. Every scanner owns a ring with the times of its last
+ * threshold refusals, so the threshold is reached when the oldest of them is still within the window. Table and rings
+ * are allocated up front and a lookup probes at most maxProbes slots. When all probed slots are in use, the scanner
+ * whose last refusal is the oldest is replaced.
+ */
+class RefusalCounter {
+public:
+    /**
+     * @param capacity Number of scanners, rounded up to a power of two.
+     * @param threshold Number of refusals that raise an alarm.
+     * @param window Time window in nanoseconds.
+     */
+    RefusalCounter(uint32_t capacity, uint32_t threshold, int64_t window);
+
+    /**
+     * Records a refusal of a scanner. When the threshold is reached, the scanner's ring is cleared, so the next alarm
+     * needs threshold new refusals.
+     *
+     * @param scanner Serial number of the scanner.
+     * @param now Time of the refusal in nanoseconds.
+     * @param firstRefusal Receives the time of the oldest counted refusal when true is returned.
+     * @return true if the scanner has reached the threshold within the window.
+     */
+    bool add(uint64_t scanner, int64_t now, int64_t &firstRefusal);
+
+    uint32_t threshold() const { return _threshold; }
+private:
+    static constexpr uint32_t maxProbes = 8;
+
+    struct Entry {
+        uint64_t scanner = 0;
+        int64_t last = 0; //0 marks a free slot
+        uint32_t count = 0;
+        uint32_t next = 0;
+    };
+
+    std::unique_ptr<Entry[]> _entries;
+    std::unique_ptr<int64_t[]> _times; //threshold times per entry
+    uint32_t _mask = 0;
+    uint32_t _threshold = 1;
+    int64_t _window = 0;
+};
+
+}
+#endif
@@ -0,0 +1,109 @@
+#include "SenderFilter.h"
+
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <algorithm>
+#include <cstring>
+
+namespace Ekey {
+
+bool AllowList::parse(const std::string &setting, std::string &error) {
+    _networks.clear();
+    std::string entry;
+    for (size_t i = 0; i <= setting.size(); i++) {
+        char c = i < setting.size() ? setting[i] : ' ';
+        if (c != ' ' && c != ',' && c != '\t' && c != '\r' && c != '\n') {
+            entry.push_back(c);
+            continue;
+        }
+        if (entry.empty()) continue;
+
+        Network network;
+        std::string address = entry;
+        auto slash = entry.find('/');
+        if (slash != std::string::npos) address = entry.substr(0, slash);
+
+        in_addr v4{};
+        in6_addr v6{};
+        uint32_t maxPrefixLength = 128;
+        if (inet_pton(AF_INET, address.c_str(), &v4) == 1) {
+            sockaddr_storage sender{};
+            sender.ss_family = AF_INET;
+            ((sockaddr_in &)sender).sin_addr = v4;
+            network.address = SenderKey::get(sender);
+            maxPrefixLength = 32;
+        } else if (inet_pton(AF_INET6, address.c_str(), &v6) == 1) {
+            std::memcpy(network.address.address.data(), &v6, 16);
+        } else {
+            error = "Invalid address \"" + entry + "\" in allowed senders.";
+            return false;
+        }
+
+        uint32_t prefixLength = maxPrefixLength;
+        if (slash != std::string::npos) {
+            char *end = nullptr;
+            auto prefix = entry.c_str() + slash + 1;
+            prefixLength = (uint32_t)std::strtoul(prefix, &end, 10);
+            if (end == prefix || *end != 0 || prefixLength > maxPrefixLength) {
+                error = "Invalid prefix length in \"" + entry + "\" in allowed senders.";
+                return false;
+            }
+        }
+        //IPv4 networks are matched against the IPv4-mapped form
+        network.prefixLength = maxPrefixLength == 32 ? prefixLength + 96 : prefixLength;
+        _networks.push_back(network);
+        entry.clear();
+    }
+    return true;
+}
+
+bool AllowList::isAllowed(const SenderKey &sender) const {
+    if (_networks.empty()) return true;
+    auto &address = sender.address;
+    for (auto &network : _networks) {
+        uint32_t fullBytes = network.prefixLength / 8;
+        if (std::memcmp(network.address.address.data(), address.data(), fullBytes) != 0) continue;
+        uint32_t remainingBits = network.prefixLength % 8;
+        if (remainingBits == 0) return true;
+        uint8_t mask = (uint8_t)(0xFF << (8 - remainingBits));
+        if ((network.address.address[fullBytes] & mask) == (address[fullBytes] & mask)) return true;
+    }
+    return false;
+}
+
+RateLimiter::RateLimiter(uint32_t capacity, uint32_t rate, uint32_t burst) {
+    uint32_t size = maxProbes;
+    while (size < capacity) size <<= 1;
+    _mask = size - 1;
+    _entries.reset(new Entry[size]);
+    _interval = 1000000000LL / std::max(rate, 1u);
+    _tolerance = _interval * (int64_t)(std::max(burst, 1u) - 1);
+}
+
+bool RateLimiter::acquire(const SenderKey &sender, int64_t now) {
+    auto address = sender.getAddressKey();
+    uint64_t hash = address.hash();
+    Entry *entry = nullptr;
+    Entry *replace = nullptr;
+    for (uint32_t i = 0; i < maxProbes; i++) {
+        Entry &candidate = _entries[(hash + i) & _mask];
+        if (candidate.fullAt != 0 && candidate.address == address) {
+            entry = &candidate;
+            break;
+        }
+        //Prefer free slots, then the bucket that has been full the longest
+        if (!replace || candidate.fullAt < replace->fullAt) replace = &candidate;
+    }
+    if (!entry) {
+        entry = replace;
+        entry->address = address;
+        entry->fullAt = now;
+    }
+
+    int64_t fullAt = std::max(entry->fullAt, now);
+    if (fullAt - now > _tolerance) return false;
+    entry->fullAt = fullAt + _interval;
+    return true;
+}
+
+}
@@ -0,0 +1,69 @@
+#ifndef EKEY_SENDERFILTER_H_
+#define EKEY_SENDERFILTER_H_
+
+#include "SenderKey.h"
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace Ekey {
+
+/**
+ * List of allowed IP addresses and networks. An empty list allows every sender. The port of a sender is ignored.
+ */
+class AllowList {
+public:
+    /**
+     * @param setting Addresses or networks in CIDR notation, separated by whitespace or commas, e. g.
+     * "192.168.0.10 10.1.0.0/16 fd00::/8".
+     */
+    bool parse(const std::string &setting, std::string &error);
+    bool empty() const { return _networks.empty(); }
+    bool isAllowed(const SenderKey &sender) const;
+private:
+    struct Network {
+        SenderKey address;
+        uint32_t prefixLength = 128;
+    };
+
+    std::vector<Network> _networks;
+};
+
+/**
+ * Per sender IP token buckets in a fixed size, open addressed table. A bucket is stored as the time it is full again
+ * (generic cell rate algorithm), so refilling needs no timer and a bucket that is full can be evicted without losing
+ * state. Lookups probe at most maxProbes slots and never allocate.
+ */
+class RateLimiter {
+public:
+    /**
+     * @param capacity Number of senders tracked at once, rounded up to a power of two.
+     * @param rate Packets per second per sender.
+     * @param burst Number of packets a sender may send at once.
+     */
+    RateLimiter(uint32_t capacity, uint32_t rate, uint32_t burst);
+
+    /**
+     * Takes a token from the sender's bucket.
+     *
+     * @param now Monotonic time in nanoseconds.
+     * @return false if the bucket is empty and the packet should be dropped.
+     */
+    bool acquire(const SenderKey &sender, int64_t now);
+private:
+    static constexpr uint32_t maxProbes = 8;
+
+    struct Entry {
+        SenderKey address;
+        int64_t fullAt = 0; //0 marks a free slot
+    };
+
+    std::unique_ptr<Entry[]> _entries;
+    uint32_t _mask = 0;
+    int64_t _interval = 0;
+    int64_t _tolerance = 0;
+};
+
+}
+#endif
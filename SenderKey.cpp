@@ -0,0 +1,61 @@
+#include "SenderKey.h"
+
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <algorithm>
+#include <cstring>
+
+namespace Ekey {
+
+namespace {
+
+constexpr std::array<uint8_t, 12> v4MappedPrefix{0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xFF, 0xFF};
+
+}
+
+SenderKey SenderKey::get(const sockaddr_storage &sender) {
+    SenderKey key;
+    if (sender.ss_family == AF_INET) {
+        auto &address = (const sockaddr_in &)sender;
+        std::copy(v4MappedPrefix.begin(), v4MappedPrefix.end(), key.address.begin());
+        std::memcpy(key.address.data() + 12, &address.sin_addr, 4);
+        key.port = ntohs(address.sin_port);
+    } else if (sender.ss_family == AF_INET6) {
+        auto &address = (const sockaddr_in6 &)sender;
+        std::memcpy(key.address.data(), &address.sin6_addr, 16);
+        key.port = ntohs(address.sin6_port);
+    }
+    return key;
+}
+
+bool SenderKey::isV4() const {
+    return std::equal(v4MappedPrefix.begin(), v4MappedPrefix.end(), address.begin());
+}
+
+SenderKey SenderKey::getAddressKey() const {
+    SenderKey key;
+    key.address = address;
+    return key;
+}
+
+std::string SenderKey::getAddressString() const {
+    std::array<char, INET6_ADDRSTRLEN + 1> buffer{};
+    if (isV4()) inet_ntop(AF_INET, address.data() + 12, buffer.data(), buffer.size());
+    else inet_ntop(AF_INET6, address.data(), buffer.data(), buffer.size());
+    buffer.back() = 0;
+    return std::string(buffer.data());
+}
+
+uint64_t SenderKey::hash() const {
+    uint64_t high;
+    uint64_t low;
+    std::memcpy(&high, address.data(), 8);
+    std::memcpy(&low, address.data() + 8, 8);
+    uint64_t value = (high * 0x9e3779b97f4a7c15ULL) ^ low ^ ((uint64_t)port << 48);
+    value ^= value >> 33;
+    value *= 0xff51afd7ed558ccdULL;
+    value ^= value >> 33;
+    return value;
+}
+
+}
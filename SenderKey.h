@@ -0,0 +1,38 @@
+#ifndef EKEY_SENDERKEY_H_
+#define EKEY_SENDERKEY_H_
+
+#include <sys/socket.h>
+#include <array>
+#include <cstdint>
+#include <string>
+
+namespace Ekey {
+
+/**
+ * Compact binary form of a sender's address and port as used everywhere after the socket. IPv4 addresses are stored
+ * IPv4-mapped, so datagrams of both families, including IPv4 datagrams received on a dual-stack socket, compare and hash
+ * the same way. Nothing is formatted until an event is output.
+ */
+struct SenderKey {
+    std::array<uint8_t, 16> address{};
+    uint16_t port = 0; //Host byte order
+
+    static SenderKey get(const sockaddr_storage &sender);
+
+    bool isV4() const;
+    /**
+     * @return The same address with port 0, for everything that is tracked per IP address.
+     */
+    SenderKey getAddressKey() const;
+    std::string getAddressString() const;
+    uint64_t hash() const;
+
+    bool operator==(const SenderKey &other) const { return address == other.address && port == other.port; }
+
+    struct Hash {
+        size_t operator()(const SenderKey &key) const { return (size_t)key.hash(); }
+    };
+};
+
+}
+#endif
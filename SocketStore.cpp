@@ -0,0 +1,90 @@
+#include "SocketStore.h"
+
+#include <unistd.h>
+#include <algorithm>
+
+namespace Ekey {
+
+SocketStore &SocketStore::instance() {
+    static SocketStore store;
+    return store;
+}
+
+SocketStore::SocketStore() {
+    _thread = std::thread(&SocketStore::closeExpired, this);
+}
+
+SocketStore::~SocketStore() {
+    {
+        std::lock_guard<std::mutex> storeGuard(_mutex);
+        _stop = true;
+    }
+    _conditionVariable.notify_one();
+    if (_thread.joinable()) _thread.join();
+    for (auto &entry : _entries) {
+        close(entry.socketDescriptor);
+    }
+}
+
+void SocketStore::park(const Key &key, int socketDescriptor, uint32_t dropCount) {
+    {
+        std::lock_guard<std::mutex> storeGuard(_mutex);
+        //Nothing can take the socket over while the process exits
+        if (_stop) {
+            close(socketDescriptor);
+            return;
+        }
+        _entries.push_back(Entry{key, socketDescriptor, dropCount, std::chrono::steady_clock::now() + gracePeriod});
+    }
+    _conditionVariable.notify_one();
+}
+
+int SocketStore::take(const Key &key, uint32_t &dropCount) {
+    std::lock_guard<std::mutex> storeGuard(_mutex);
+    for (auto entry = _entries.begin(); entry != _entries.end(); ++entry) {
+        if (entry->key == key) {
+            int socketDescriptor = entry->socketDescriptor;
+            dropCount = entry->dropCount;
+            _entries.erase(entry);
+            return socketDescriptor;
+        }
+    }
+    return -1;
+}
+
+void SocketStore::closeUnused(const std::string &nodeId, const std::function<bool(const Key &key)> &isUsed) {
+    std::lock_guard<std::mutex> storeGuard(_mutex);
+    for (auto entry = _entries.begin(); entry != _entries.end();) {
+        if (entry->key.nodeId != nodeId || isUsed(entry->key)) {
+            ++entry;
+            continue;
+        }
+        close(entry->socketDescriptor);
+        entry = _entries.erase(entry);
+    }
+}
+
+void SocketStore::closeExpired() {
+    std::unique_lock<std::mutex> storeGuard(_mutex);
+    while (!_stop) {
+        if (_entries.empty()) {
+            _conditionVariable.wait(storeGuard);
+            continue;
+        }
+
+        auto now = std::chrono::steady_clock::now();
+        auto nextExpiry = std::chrono::steady_clock::time_point::max();
+        for (auto entry = _entries.begin(); entry != _entries.end();) {
+            if (entry->expires > now) {
+                nextExpiry = std::min(nextExpiry, entry->expires);
+                ++entry;
+                continue;
+            }
+            close(entry->socketDescriptor);
+            entry = _entries.erase(entry);
+        }
+        if (nextExpiry != std::chrono::steady_clock::time_point::max()) _conditionVariable.wait_until(storeGuard, nextExpiry);
+    }
+}
+
+}
@@ -0,0 +1,77 @@
+#ifndef EKEY_SOCKETSTORE_H_
+#define EKEY_SOCKETSTORE_H_
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace Ekey {
+
+/**
+ * Bound sockets of stopped nodes, shared by all nodes of the process. node-blue destroys a node on every redeploy and
+ * creates a new instance, so a socket can only survive the redeploy outside of the instance. The listen threads park
+ * their sockets here when they exit and the next instance with the same node ID takes them over without rebinding,
+ * while the kernel keeps queueing datagrams. A socket that is not taken over within gracePeriod is closed.
+ */
+class SocketStore {
+public:
+    static constexpr std::chrono::seconds gracePeriod{10};
+
+    struct Key {
+        std::string nodeId;
+        std::string address;
+        uint16_t port = 0;
+        uint32_t worker = 0;
+        bool reusePort = false;
+
+        bool operator==(const Key &other) const {
+            return nodeId == other.nodeId && address == other.address && port == other.port && worker == other.worker && reusePort == other.reusePort;
+        }
+    };
+
+    static SocketStore &instance();
+
+    /**
+     * Takes ownership of a bound socket until gracePeriod expires.
+     *
+     * @param dropCount The last SO_RXQ_OVFL value of the socket, the kernel keeps counting from there.
+     */
+    void park(const Key &key, int socketDescriptor, uint32_t dropCount);
+
+    /**
+     * @param dropCount Receives the last SO_RXQ_OVFL value of the socket.
+     * @return The parked socket or -1 if there is none for key.
+     */
+    int take(const Key &key, uint32_t &dropCount);
+
+    /**
+     * Closes the parked sockets of a node the new instance does not use. They must be closed before the new instance
+     * binds its sockets, otherwise its bind would fail.
+     */
+    void closeUnused(const std::string &nodeId, const std::function<bool(const Key &key)> &isUsed);
+private:
+    struct Entry {
+        Key key;
+        int socketDescriptor = -1;
+        uint32_t dropCount = 0;
+        std::chrono::steady_clock::time_point expires;
+    };
+
+    std::mutex _mutex;
+    std::condition_variable _conditionVariable;
+    std::vector<Entry> _entries;
+    bool _stop = false;
+    std::thread _thread; //Closes expired sockets, waits without a timeout while nothing is parked
+
+    SocketStore();
+    ~SocketStore();
+    void closeExpired();
+};
+
+}
+#endif
@@ -0,0 +1,154 @@
+/* Checks that the batch decoder returns the same results as the packet parser with every instruction set.
+ *
+ * Usage: ekey-batch-decoder-test
+ *
+ * Returns 0 if all checks pass. Instruction sets the CPU does not support are skipped.
+ */
+
+#include "../BatchDecoder.h"
+#include "Check.h"
+
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace Ekey;
+using Ekey::Test::check;
+
+namespace {
+
+const std::string homePacket = "1_0046_4_80156809150025_1_2";
+const std::string multiPacket = "10003JOSEF----17280156809150025GAR-1-";
+//Valid characters of all fields, the separator and bytes no field accepts
+const std::string alphabet = std::string("0123456789ABCDEFabcdefRd-_ xz/:") + '\0' + '\x7f' + '\x80' + '\xff';
+
+char getRandomCharacter(std::mt19937 &random, const char *characters) {
+    std::string_view view(characters);
+    return view[random() % view.size()];
+}
+
+std::string getRandomHomePacket(std::mt19937 &random) {
+    std::string packet = homePacket;
+    packet[HomeLayout::packetType.offset] = getRandomCharacter(random, "0123456789");
+    for (uint32_t i = 0; i < HomeLayout::userId.length; i++) packet[HomeLayout::userId.offset + i] = getRandomCharacter(random, "0123456789");
+    packet[HomeLayout::fingerId.offset] = getRandomCharacter(random, "0123456789R-");
+    for (uint32_t i = 0; i < HomeLayout::serialNr.length; i++) packet[HomeLayout::serialNr.offset + i] = getRandomCharacter(random, "0123456789");
+    packet[HomeLayout::action.offset] = getRandomCharacter(random, "0123456789");
+    packet[HomeLayout::relayId.offset] = getRandomCharacter(random, "0123456789d-");
+    return packet;
+}
+
+std::string getRandomMultiPacket(std::mt19937 &random) {
+    std::string packet = multiPacket;
+    packet[MultiLayout::packetType.offset] = getRandomCharacter(random, "0123456789");
+    for (uint32_t i = 0; i < MultiLayout::userId.length; i++) packet[MultiLayout::userId.offset + i] = getRandomCharacter(random, "0123456789");
+    for (uint32_t i = 0; i < MultiLayout::userName.length; i++) packet[MultiLayout::userName.offset + i] = getRandomCharacter(random, "ABCXYZ-_ ");
+    packet[MultiLayout::userState.offset] = getRandomCharacter(random, "01-");
+    packet[MultiLayout::fingerId.offset] = getRandomCharacter(random, "0123456789R-");
+    packet[MultiLayout::keyId.offset] = getRandomCharacter(random, "0123456789-");
+    for (uint32_t i = 0; i < MultiLayout::serialNr.length; i++) packet[MultiLayout::serialNr.offset + i] = getRandomCharacter(random, "0123456789");
+    for (uint32_t i = 0; i < MultiLayout::readerName.length; i++) packet[MultiLayout::readerName.offset + i] = getRandomCharacter(random, "ABGR-_");
+    packet[MultiLayout::action.offset] = getRandomCharacter(random, "0123456789ABCDEF");
+    packet[MultiLayout::inputId.offset] = getRandomCharacter(random, "0123456789-");
+    return packet;
+}
+
+std::vector<std::string> getCorpus() {
+    std::mt19937 random(0x656b6579);
+    std::vector<std::string> corpus;
+
+    //Every position of both formats with every character, which covers each HOME separator position
+    for (auto &packet : {homePacket, multiPacket}) {
+        for (size_t position = 0; position < packet.size(); position++) {
+            for (char character : alphabet) {
+                std::string corrupted = packet;
+                corrupted[position] = character;
+                corpus.push_back(corrupted);
+            }
+        }
+    }
+
+    //Valid and invalid values in all fields, some with further corruption or a different length
+    for (uint32_t i = 0; i < 100000; i++) {
+        std::string packet = i % 2 == 0 ? getRandomHomePacket(random) : getRandomMultiPacket(random);
+        uint32_t mutations = random() % 4 == 0 ? random() % 3 + 1 : 0;
+        for (uint32_t j = 0; j < mutations; j++) packet[random() % packet.size()] = alphabet[random() % alphabet.size()];
+        if (random() % 50 == 0) packet.pop_back();
+        else if (random() % 50 == 0) packet.push_back('_');
+        corpus.push_back(packet);
+    }
+    corpus.push_back("");
+    corpus.push_back(homePacket + multiPacket);
+    return corpus;
+}
+
+bool isEqual(const HomePacket &a, const HomePacket &b) {
+    return a.packetType == b.packetType && a.userId == b.userId && a.fingerId == b.fingerId && a.serialNr == b.serialNr && a.action == b.action && a.relayId == b.relayId;
+}
+
+bool isEqual(const MultiPacket &a, const MultiPacket &b) {
+    return a.packetType == b.packetType && a.userId == b.userId && a.userName == b.userName && a.userState == b.userState && a.fingerId == b.fingerId &&
+           a.keyId == b.keyId && a.serialNr == b.serialNr && a.readerName == b.readerName && a.action == b.action && a.inputId == b.inputId;
+}
+
+void testEquivalence(InstructionSet instructionSet, const std::vector<std::string_view> &packets) {
+    HomeColumns homeColumns;
+    MultiColumns multiColumns;
+    BatchDecoder::decodeHome(packets.data(), packets.size(), homeColumns);
+    BatchDecoder::decodeMulti(packets.data(), packets.size(), multiColumns);
+
+    bool homeErrors = homeColumns.size() == packets.size();
+    bool homeFields = true;
+    bool multiErrors = multiColumns.size() == packets.size();
+    bool multiFields = true;
+    size_t validHome = 0;
+    size_t validMulti = 0;
+    for (size_t i = 0; i < packets.size() && homeErrors && multiErrors; i++) {
+        HomePacket homePacket;
+        ParseError error = PacketParser::parseHome(packets[i], homePacket);
+        homeErrors = homeErrors && homeColumns.error[i] == error;
+        if (error == ParseError::none) {
+            validHome++;
+            homeFields = homeFields && isEqual(homeColumns.getPacket(i), homePacket);
+        }
+
+        MultiPacket multiPacket;
+        error = PacketParser::parseMulti(packets[i], multiPacket);
+        multiErrors = multiErrors && multiColumns.error[i] == error;
+        if (error == ParseError::none) {
+            validMulti++;
+            multiFields = multiFields && isEqual(multiColumns.getPacket(i), multiPacket);
+        }
+    }
+
+    std::string name(BatchDecoder::getInstructionSetName(instructionSet));
+    check(homeErrors, ("HOME errors match parseHome with " + name).c_str());
+    check(homeFields, ("HOME fields match parseHome with " + name).c_str());
+    check(multiErrors, ("MULTI errors match parseMulti with " + name).c_str());
+    check(multiFields, ("MULTI fields match parseMulti with " + name).c_str());
+    check(validHome > 1000 && validMulti > 1000, ("corpus contains valid packets of both formats with " + name).c_str());
+
+    //Batches of one exercise the paths for the last packets of a batch
+    bool single = true;
+    for (size_t i = 0; i < 1000 && single; i++) {
+        BatchDecoder::decodeHome(&packets[i], 1, homeColumns);
+        HomePacket homePacket;
+        single = homeColumns.size() == 1 && homeColumns.error[0] == PacketParser::parseHome(packets[i], homePacket);
+    }
+    check(single, ("HOME batches of one match parseHome with " + name).c_str());
+}
+
+}
+
+int main() {
+    auto corpus = getCorpus();
+    std::vector<std::string_view> packets(corpus.begin(), corpus.end());
+    for (auto instructionSet : {InstructionSet::scalar, InstructionSet::sse2, InstructionSet::avx2}) {
+        if (!BatchDecoder::setInstructionSet(instructionSet)) {
+            printf("Skipping %s, the CPU does not support it.\n", BatchDecoder::getInstructionSetName(instructionSet).data());
+            continue;
+        }
+        testEquivalence(instructionSet, packets);
+    }
+    return Ekey::Test::finish();
+}
@@ -0,0 +1,28 @@
+#ifndef EKEY_TESTS_CHECK_H_
+#define EKEY_TESTS_CHECK_H_
+
+#include <cstdio>
+
+namespace Ekey::Test {
+
+inline int &failures() {
+    static int count = 0;
+    return count;
+}
+
+inline void check(bool condition, const char *description) {
+    if (condition) return;
+    printf("FAILED: %s\n", description);
+    failures()++;
+}
+
+/**
+ * @return The exit code of the test, 0 if all checks passed.
+ */
+inline int finish() {
+    if (failures() == 0) printf("All checks passed.\n");
+    return failures() == 0 ? 0 : 1;
+}
+
+}
+#endif
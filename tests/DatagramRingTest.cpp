@@ -0,0 +1,128 @@
+/* Checks of the ring between the listen threads and the dispatch thread.
+ *
+ * Usage: ekey-ring-test
+ *
+ * Returns 0 if all checks pass.
+ */
+
+#include "../DatagramRing.h"
+#include "Check.h"
+
+#include <cstring>
+#include <thread>
+
+using namespace Ekey;
+using Ekey::Test::check;
+
+namespace {
+
+bool push(DatagramRing &ring, uint32_t id) {
+    Datagram *datagram = ring.beginPush();
+    if (!datagram) return false;
+    std::memcpy(datagram->data.data(), &id, sizeof(id));
+    datagram->size = sizeof(id);
+    ring.commit();
+    return true;
+}
+
+//Pushes like a listen thread with OverflowPolicy::dropOldest
+void pushDropOldest(DatagramRing &ring, uint32_t id, uint32_t &dropped) {
+    while (!push(ring, id)) {
+        if (ring.pop(nullptr)) dropped++;
+    }
+}
+
+uint32_t getId(const Datagram &datagram) {
+    uint32_t id = 0;
+    std::memcpy(&id, datagram.data.data(), sizeof(id));
+    return id;
+}
+
+void testCapacity() {
+    check(DatagramRing(1).capacity() == 2, "capacity 1 is raised to 2");
+    check(DatagramRing(5).capacity() == 8, "capacity is rounded up to a power of two");
+    check(DatagramRing(1024).capacity() == 1024, "power of two capacity is kept");
+}
+
+void testFifo() {
+    DatagramRing ring(4);
+    Datagram datagram;
+    check(ring.empty() && !ring.pop(&datagram), "new ring is empty");
+    for (uint32_t i = 0; i < 4; i++) push(ring, i);
+    check(!push(ring, 4), "full ring refuses a push");
+    bool ordered = true;
+    for (uint32_t i = 0; i < 4; i++) ordered = ordered && ring.pop(&datagram) && getId(datagram) == i;
+    check(ordered, "entries are popped in order");
+    check(ring.empty(), "ring is empty after popping all entries");
+}
+
+void testDropOldest() {
+    DatagramRing ring(4);
+    uint32_t dropped = 0;
+    for (uint32_t i = 0; i < 10; i++) pushDropOldest(ring, i, dropped);
+    check(dropped == 6, "overflow drops one entry per push");
+    Datagram datagram;
+    bool newest = true;
+    for (uint32_t i = 6; i < 10; i++) newest = newest && ring.pop(&datagram) && getId(datagram) == i;
+    check(newest, "overflow keeps the newest entries");
+    check(ring.empty(), "ring is empty after overflow and popping");
+}
+
+void testWraparound() {
+    //The positions run many times around the slots, so every slot is reused with a later sequence number
+    DatagramRing ring(2);
+    Datagram datagram;
+    bool ordered = true;
+    uint32_t dropped = 0;
+    for (uint32_t i = 0; i < 100000; i++) {
+        pushDropOldest(ring, i * 2, dropped);
+        pushDropOldest(ring, i * 2 + 1, dropped);
+        ordered = ordered && ring.pop(&datagram) && getId(datagram) == i * 2;
+        ordered = ordered && ring.pop(&datagram) && getId(datagram) == i * 2 + 1;
+        ordered = ordered && !ring.pop(&datagram);
+    }
+    check(ordered && dropped == 0, "ring keeps the order after wrapping around");
+}
+
+void testConcurrent() {
+    //The producer drops the oldest entries while the consumer pops, every entry is either received once or dropped
+    constexpr uint32_t count = 1000000;
+    DatagramRing ring(8);
+    uint32_t dropped = 0;
+    std::atomic_bool done{false};
+    std::thread producer([&]() {
+        for (uint32_t i = 0; i < count; i++) pushDropOldest(ring, i, dropped);
+        done = true;
+    });
+
+    uint32_t received = 0;
+    int64_t lastId = -1;
+    bool ordered = true;
+    Datagram datagram;
+    while (true) {
+        if (ring.pop(&datagram)) {
+            uint32_t id = getId(datagram);
+            ordered = ordered && (int64_t)id > lastId && datagram.size == sizeof(id);
+            lastId = id;
+            received++;
+        } else if (done) {
+            if (ring.empty()) break;
+        }
+    }
+    producer.join();
+
+    check(ordered, "concurrent entries arrive in order and complete");
+    check(received + dropped == count, "concurrent entries are received or dropped exactly once");
+    check(lastId == count - 1, "last concurrent entry is received");
+}
+
+}
+
+int main() {
+    testCapacity();
+    testFifo();
+    testDropOldest();
+    testWraparound();
+    testConcurrent();
+    return Ekey::Test::finish();
+}
@@ -0,0 +1,105 @@
+/* Checks of the duplicate suppression.
+ *
+ * Usage: ekey-duplicate-test
+ *
+ * Returns 0 if all checks pass.
+ */
+
+#include "../DuplicateFilter.h"
+#include "Check.h"
+
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <string>
+
+using namespace Ekey;
+using Ekey::Test::check;
+
+namespace {
+
+constexpr int64_t millisecond = 1000000;
+constexpr int64_t window = 100 * millisecond;
+
+SenderKey getSender(const char *address, uint16_t port) {
+    sockaddr_storage storage{};
+    auto *sender = (sockaddr_in *)&storage;
+    sender->sin_family = AF_INET;
+    sender->sin_port = htons(port);
+    inet_pton(AF_INET, address, &sender->sin_addr);
+    return SenderKey::get(storage);
+}
+
+std::string getPacket(uint32_t userId) {
+    std::string packet = "1_0000_4_80156809150025_1_2";
+    std::string id = std::to_string(userId % 10000);
+    packet.replace(6 - id.size(), id.size(), id);
+    return packet;
+}
+
+void testWindow() {
+    DuplicateFilter filter(64, window);
+    auto sender = getSender("192.168.0.10", 56000);
+    auto packet = getPacket(46);
+    check(!filter.isDuplicate(sender, packet, 1000 * millisecond), "first packet is accepted");
+    check(filter.isDuplicate(sender, packet, 1050 * millisecond), "repeat within the window is dropped");
+    //The repeat above must not have extended the window
+    check(!filter.isDuplicate(sender, packet, 1100 * millisecond), "repeat after the window is accepted");
+    check(filter.isDuplicate(sender, packet, 1199 * millisecond), "accepted repeat starts a new window");
+}
+
+void testKey() {
+    DuplicateFilter filter(64, window);
+    auto sender = getSender("192.168.0.10", 56000);
+    check(!filter.isDuplicate(sender, getPacket(46), 0), "first packet is accepted");
+    check(!filter.isDuplicate(sender, getPacket(47), 0), "other packet of the same sender is accepted");
+    check(!filter.isDuplicate(getSender("192.168.0.11", 56000), getPacket(46), 0), "same packet of another address is accepted");
+    check(!filter.isDuplicate(getSender("192.168.0.10", 56001), getPacket(46), 0), "same packet of another port is accepted");
+    check(!filter.isDuplicate(sender, getPacket(46).substr(0, 26), 0), "prefix of a packet is accepted");
+}
+
+void testFullTable() {
+    //With 8 entries every lookup probes the whole table, so every packet collides with all others
+    DuplicateFilter filter(1, window);
+    auto sender = getSender("192.168.0.10", 56000);
+    bool accepted = true;
+    for (uint32_t i = 0; i < 8; i++) accepted = accepted && !filter.isDuplicate(sender, getPacket(i), i * millisecond);
+    check(accepted, "packets filling the table are accepted");
+    bool dropped = true;
+    for (uint32_t i = 0; i < 8; i++) dropped = dropped && filter.isDuplicate(sender, getPacket(i), 10 * millisecond);
+    check(dropped, "all packets in the full table are found");
+
+    //The entry that expires first makes room
+    check(!filter.isDuplicate(sender, getPacket(8), 10 * millisecond), "packet beyond the capacity is accepted");
+    check(filter.isDuplicate(sender, getPacket(8), 11 * millisecond), "packet beyond the capacity is remembered");
+    check(filter.isDuplicate(sender, getPacket(7), 11 * millisecond), "newest entry survives the replacement");
+    check(!filter.isDuplicate(sender, getPacket(0), 11 * millisecond), "oldest entry was replaced");
+
+    //Expired entries are reused before live ones are replaced
+    bool reused = true;
+    for (uint32_t i = 20; i < 28; i++) reused = reused && !filter.isDuplicate(sender, getPacket(i), 200 * millisecond);
+    check(reused, "expired entries are reused");
+    reused = true;
+    for (uint32_t i = 20; i < 28; i++) reused = reused && filter.isDuplicate(sender, getPacket(i), 201 * millisecond);
+    check(reused, "packets in reused entries are found");
+}
+
+void testManySenders() {
+    //At a quarter of the capacity, colliding probe sequences still find a free slot, so no live entry is replaced
+    DuplicateFilter filter(4096, window);
+    bool accepted = true;
+    for (uint32_t i = 0; i < 1024; i++) accepted = accepted && !filter.isDuplicate(getSender("10.0.0.1", (uint16_t)(1024 + i)), getPacket(i), 0);
+    check(accepted, "distinct packets are accepted");
+    bool found = true;
+    for (uint32_t i = 0; i < 1024; i++) found = found && filter.isDuplicate(getSender("10.0.0.1", (uint16_t)(1024 + i)), getPacket(i), millisecond);
+    check(found, "all live entries are found");
+}
+
+}
+
+int main() {
+    testWindow();
+    testKey();
+    testFullTable();
+    testManySenders();
+    return Ekey::Test::finish();
+}
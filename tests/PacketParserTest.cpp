@@ -0,0 +1,150 @@
+/* Checks of the packet parser that need no running node.
+ *
+ * Usage: ekey-parser-test
+ *
+ * Returns 0 if all checks pass.
+ */
+
+#include "../PacketParser.h"
+#include "Check.h"
+
+#include <cstring>
+#include <string>
+
+using namespace Ekey;
+using Ekey::Test::check;
+
+namespace {
+
+void testHome() {
+    HomePacket packet;
+    check(PacketParser::parseHome("1_0046_4_80156809150025_1_2", packet) == ParseError::none, "valid HOME packet is decoded");
+    check(packet.packetType == 1 && packet.userId == 46 && packet.fingerId == 4 && packet.serialNr == "80156809150025" && packet.action == 1 && packet.relayId == 2, "HOME fields");
+
+    check(PacketParser::parseHome("1_0000_R_80156809150025_2_d", packet) == ParseError::none, "HOME packet with special values is decoded");
+    check(packet.fingerId == fingerRfid && packet.relayId == relayMultiple && packet.action == 2, "HOME special values");
+    check(PacketParser::parseHome("1_0000_-_80156809150025_2_-", packet) == ParseError::none && packet.fingerId == fingerNone && packet.relayId == relayNone, "HOME dashes");
+
+    check(PacketParser::parseHome("", packet) == ParseError::lengthMismatch, "empty HOME packet");
+    check(PacketParser::parseHome("1_0046_4_80156809150025_1_", packet) == ParseError::lengthMismatch, "HOME packet with truncated last field");
+    check(PacketParser::parseHome("1_0046_4_80156809150025_1_22", packet) == ParseError::lengthMismatch, "HOME packet with extra byte");
+    check(PacketParser::parseHome("1_00a6_4_80156809150025_1_2", packet) == ParseError::badDigit, "HOME user ID with letter");
+    check(PacketParser::parseHome("1_+046_4_80156809150025_1_2", packet) == ParseError::badDigit, "HOME user ID with sign");
+    check(PacketParser::parseHome("1_0046_x_80156809150025_1_2", packet) == ParseError::badDigit, "HOME finger out of range");
+    check(PacketParser::parseHome("1_0046_4_80156809150025_1_x", packet) == ParseError::badDigit, "HOME relay out of range");
+    check(PacketParser::parseHome("x_0046_4_80156809150025_1_2", packet) == ParseError::badDigit, "HOME packet type with letter");
+}
+
+void testHomeSeparators() {
+    HomePacket packet;
+    const std::string valid = "1_0046_4_80156809150025_1_2";
+    check(PacketParser::parseHome(valid, packet) == ParseError::none, "HOME packet with all separators is decoded");
+
+    //Every field but the last must be followed by an underscore, any other byte there is rejected
+    bool rejected = true;
+    for (auto field : HomeLayout::separatedFields) {
+        for (char separator : {'-', ' ', '0', 'x', '\0'}) {
+            std::string data = valid;
+            data[field.offset + field.length] = separator;
+            rejected = rejected && PacketParser::parseHome(data, packet) == ParseError::badSeparator;
+        }
+    }
+    check(rejected, "HOME packet with a wrong separator is rejected at every separator position");
+    check(PacketParser::parseHome("1_0046_4_80156809150025-1-2", packet) == ParseError::badSeparator, "HOME packet with dashes as separators");
+    check(PacketParser::parseHome("1_00x6_4_80156809150025-1_2", packet) == ParseError::badDigit, "bad digit takes precedence over a bad separator");
+}
+
+void testMulti() {
+    MultiPacket packet;
+    check(PacketParser::parseMulti("10003JOSEF----17280156809150025GAR-1-", packet) == ParseError::none, "valid MULTI packet is decoded");
+    check(packet.packetType == 1 && packet.userId == 3 && packet.userName == "JOSEF----" && packet.userState == 1 && packet.fingerId == 7 && packet.keyId == 2 &&
+          packet.serialNr == "80156809150025" && packet.readerName == "GAR-" && packet.action == 1 && packet.inputId == inputNone, "MULTI fields");
+
+    check(PacketParser::parseMulti("10003JOSEF-----R-80156809150025GAR-B3", packet) == ParseError::none, "MULTI packet with special values is decoded");
+    check(packet.userState == userStateUndefined && packet.fingerId == fingerRfid && packet.keyId == keyMain && packet.action == 11 && packet.inputId == 3, "MULTI special values");
+
+    check(PacketParser::parseMulti("10003JOSEF----17280156809150025GAR-1", packet) == ParseError::lengthMismatch, "MULTI packet with truncated last field");
+    check(PacketParser::parseMulti("1000xJOSEF----17280156809150025GAR-1-", packet) == ParseError::badDigit, "MULTI user ID with letter");
+    check(PacketParser::parseMulti("10003JOSEF----x7280156809150025GAR-1-", packet) == ParseError::badDigit, "MULTI user state out of range");
+    check(PacketParser::parseMulti("10003JOSEF----17x80156809150025GAR-1-", packet) == ParseError::badDigit, "MULTI key out of range");
+    check(PacketParser::parseMulti("10003JOSEF----17280156809150025GAR-G-", packet) == ParseError::badDigit, "MULTI action out of hex range");
+    check(PacketParser::parseMulti("10003JOSEF----17280156809150025GAR-1x", packet) == ParseError::badDigit, "MULTI input out of range");
+}
+
+void testSerialNumber() {
+    check(PacketParser::getSerialNumber("80156809150025") == 80156809150025, "numeric serial number");
+    check(PacketParser::getSerialNumber("") == -1, "empty serial number");
+    check(PacketParser::getSerialNumber("8015680915002x") == -1, "serial number with letter");
+    check(PacketParser::getSerialNumber("-8015680915002") == -1, "serial number with sign");
+    check(PacketParser::getSerialNumber("9223372036854775807") == INT64_MAX, "largest serial number");
+    check(PacketParser::getSerialNumber("9223372036854775808") == -1, "serial number out of range");
+    check(PacketParser::getSerialNumber("99999999999999999999") == -1, "serial number overflowing 64 bits");
+}
+
+void testDetectProtocol() {
+    Protocol protocol = Protocol::automatic;
+    check(PacketParser::detectProtocol("1_0046_4_80156809150025_1_2", protocol) && protocol == Protocol::home, "HOME packet is detected");
+    check(PacketParser::detectProtocol("10003JOSEF----17280156809150025GAR-1-", protocol) && protocol == Protocol::multi, "MULTI packet is detected");
+    check(PacketParser::detectProtocol(std::string(RareLayout::size, '\0'), protocol) && protocol == Protocol::rare, "RARE packet is detected");
+
+    //Rejected datagrams leave the protocol untouched
+    protocol = Protocol::automatic;
+    check(!PacketParser::detectProtocol("", protocol), "empty datagram is rejected");
+    check(!PacketParser::detectProtocol("1_0046_4_80156809150025_1_", protocol), "HOME packet with missing byte is rejected");
+    check(!PacketParser::detectProtocol("1_0046_4_80156809150025_1_22", protocol), "HOME packet with extra byte is rejected");
+    check(!PacketParser::detectProtocol("1_0046_4_80156809150025x1_2", protocol), "HOME length without separator is rejected");
+    check(!PacketParser::detectProtocol("1-0046-4-80156809150025-1-2", protocol), "HOME length with wrong separators is rejected");
+    check(!PacketParser::detectProtocol("1_0003_JOSEF----17280156809150025GAR-", protocol), "MULTI length starting like HOME is rejected");
+    check(!PacketParser::detectProtocol("GET / HTTP/1.1\r\nHost: 192.168.0.100\r\n", protocol), "MULTI length with text is rejected");
+    check(!PacketParser::detectProtocol(std::string(RareLayout::size - 1, '\0'), protocol), "RARE packet with missing byte is rejected");
+    check(!PacketParser::detectProtocol(std::string(RareLayout::size + 1, '\0'), protocol), "RARE packet with extra byte is rejected");
+    check(protocol == Protocol::automatic, "rejected datagrams do not set the protocol");
+}
+
+std::string getRarePacket(uint32_t terminalId) {
+    std::string packet(RareLayout::size, '\0');
+    uint32_t command = RareLayout::commandOpen;
+    std::memcpy(&packet[RareLayout::command.offset], &command, sizeof(command));
+    std::memcpy(&packet[RareLayout::terminalId.offset], &terminalId, sizeof(terminalId));
+    return packet;
+}
+
+uint32_t getTerminalAddress(uint32_t week, uint32_t year, uint32_t sequenceNumber) {
+    return RareLayout::terminalAddressBase + ((year * 53 + week) << 16) + sequenceNumber;
+}
+
+void testTerminalAddress() {
+    RarePacket packet;
+    auto data = getRarePacket(getTerminalAddress(52, 99, 9999));
+    check(PacketParser::parseRare(data, packet) == ParseError::none, "largest terminal address is decoded");
+    check(packet.productionWeek == 52 && packet.productionYear == 99 && packet.sequenceNumber == 9999, "largest terminal address fields");
+    check(PacketParser::getSerialNr(packet) == "52999999" && PacketParser::getSerialNumber(packet) == 52999999, "largest terminal address serial number");
+
+    data = getRarePacket(getTerminalAddress(3, 7, 42));
+    check(PacketParser::parseRare(data, packet) == ParseError::none && PacketParser::getSerialNr(packet) == "03070042", "serial number is padded to eight digits");
+    std::memcpy(&data[RareLayout::terminalSerial.offset], "80156809150025", 14);
+    check(PacketParser::parseRare(data, packet) == ParseError::none && PacketParser::getSerialNr(packet) == "80156809150025", "terminal serial takes precedence");
+
+    data = getRarePacket(getTerminalAddress(1, 20, 10000));
+    check(PacketParser::parseRare(data, packet) == ParseError::badTerminalAddress, "sequence number 10000 is rejected");
+
+    data = getRarePacket(getTerminalAddress(1, 100, 0));
+    check(PacketParser::parseRare(data, packet) == ParseError::badTerminalAddress, "production year 100 is rejected");
+
+    //Addresses below the base carry no serial number
+    data = getRarePacket(0x1234);
+    check(PacketParser::parseRare(data, packet) == ParseError::none, "address below the base is decoded");
+    check(packet.sequenceNumber == 0 && packet.productionYear == 0, "address below the base has no serial number");
+}
+
+}
+
+int main() {
+    testHome();
+    testHomeSeparators();
+    testMulti();
+    testSerialNumber();
+    testDetectProtocol();
+    testTerminalAddress();
+    return Ekey::Test::finish();
+}
@@ -0,0 +1,78 @@
+/* Checks of the refusal counting behind the refusal alarms.
+ *
+ * Usage: ekey-refusal-test
+ *
+ * Returns 0 if all checks pass.
+ */
+
+#include "../RefusalCounter.h"
+#include "Check.h"
+
+using namespace Ekey;
+using Ekey::Test::check;
+
+namespace {
+
+constexpr int64_t millisecond = 1000000;
+constexpr int64_t second = 1000 * millisecond;
+constexpr uint64_t scanner = 80156809150025;
+
+void testThreshold() {
+    RefusalCounter counter(16, 3, second);
+    int64_t firstRefusal = 0;
+    check(!counter.add(scanner, 1000 * millisecond, firstRefusal), "first refusal raises no alarm");
+    check(!counter.add(scanner, 1200 * millisecond, firstRefusal), "second refusal raises no alarm");
+    check(counter.add(scanner, 1400 * millisecond, firstRefusal), "third refusal within the window raises an alarm");
+    check(firstRefusal == 1000 * millisecond, "alarm carries the time of the first refusal");
+
+    //The alarm starts the count over
+    check(!counter.add(scanner, 1500 * millisecond, firstRefusal), "refusal after an alarm raises no alarm");
+    check(!counter.add(scanner, 1600 * millisecond, firstRefusal), "second refusal after an alarm raises no alarm");
+    check(counter.add(scanner, 1700 * millisecond, firstRefusal) && firstRefusal == 1500 * millisecond, "next alarm needs threshold new refusals");
+}
+
+void testSlidingWindow() {
+    RefusalCounter counter(16, 3, second);
+    int64_t firstRefusal = 0;
+    counter.add(scanner, 1000 * millisecond, firstRefusal);
+    counter.add(scanner, 1500 * millisecond, firstRefusal);
+    check(!counter.add(scanner, 2000 * millisecond, firstRefusal), "refusals spanning exactly the window raise no alarm");
+    //The oldest refusal drops out of the window, the last three are within it
+    check(counter.add(scanner, 2100 * millisecond, firstRefusal), "window slides with every refusal");
+    check(firstRefusal == 1500 * millisecond, "first refusal is the oldest within the window");
+}
+
+void testScanners() {
+    RefusalCounter counter(16, 2, second);
+    int64_t firstRefusal = 0;
+    counter.add(scanner, 1000 * millisecond, firstRefusal);
+    check(!counter.add(scanner + 1, 1100 * millisecond, firstRefusal), "other scanner counts on its own");
+    check(counter.add(scanner, 1200 * millisecond, firstRefusal) && firstRefusal == 1000 * millisecond, "scanner reaches the threshold on its own");
+    check(counter.add(scanner + 1, 1300 * millisecond, firstRefusal) && firstRefusal == 1100 * millisecond, "other scanner reaches the threshold on its own");
+
+    RefusalCounter single(16, 1, second);
+    check(single.add(scanner, 1000 * millisecond, firstRefusal) && firstRefusal == 1000 * millisecond, "threshold 1 raises an alarm on every refusal");
+}
+
+void testSlotReuse() {
+    //With 8 entries every scanner probes the whole table
+    RefusalCounter counter(1, 2, 10 * second);
+    int64_t firstRefusal = 0;
+    for (uint64_t i = 0; i < 8; i++) counter.add(scanner + i, (1000 + (int64_t)i) * millisecond, firstRefusal);
+
+    //The scanner whose last refusal is the oldest is replaced
+    check(!counter.add(scanner + 8, 1100 * millisecond, firstRefusal), "new scanner in a full table raises no alarm");
+    check(counter.add(scanner + 8, 1101 * millisecond, firstRefusal) && firstRefusal == 1100 * millisecond, "new scanner in a reused slot counts from its own refusals");
+    check(counter.add(scanner + 7, 1102 * millisecond, firstRefusal) && firstRefusal == 1007 * millisecond, "recent scanner keeps its refusals");
+    check(!counter.add(scanner, 1103 * millisecond, firstRefusal), "replaced scanner starts over");
+}
+
+}
+
+int main() {
+    testThreshold();
+    testSlidingWindow();
+    testScanners();
+    testSlotReuse();
+    return Ekey::Test::finish();
+}
@@ -0,0 +1,137 @@
+/* Checks of the allow-list and the per sender rate limit.
+ *
+ * Usage: ekey-sender-filter-test
+ *
+ * Returns 0 if all checks pass.
+ */
+
+#include "../SenderFilter.h"
+#include "Check.h"
+
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <string>
+
+using namespace Ekey;
+using Ekey::Test::check;
+
+namespace {
+
+constexpr int64_t millisecond = 1000000;
+constexpr int64_t second = 1000 * millisecond;
+
+SenderKey getSender(const char *address, uint16_t port = 56000) {
+    sockaddr_storage storage{};
+    if (inet_pton(AF_INET, address, &((sockaddr_in &)storage).sin_addr) == 1) {
+        storage.ss_family = AF_INET;
+        ((sockaddr_in &)storage).sin_port = htons(port);
+    } else if (inet_pton(AF_INET6, address, &((sockaddr_in6 &)storage).sin6_addr) == 1) {
+        storage.ss_family = AF_INET6;
+        ((sockaddr_in6 &)storage).sin6_port = htons(port);
+    }
+    return SenderKey::get(storage);
+}
+
+bool isAllowed(const std::string &setting, const char *address) {
+    AllowList allowList;
+    std::string error;
+    if (!allowList.parse(setting, error)) return false;
+    return allowList.isAllowed(getSender(address));
+}
+
+void testAllowListV4() {
+    check(isAllowed("", "192.168.0.10"), "empty list allows every sender");
+    check(isAllowed("192.168.0.10", "192.168.0.10"), "single IPv4 address");
+    check(!isAllowed("192.168.0.10", "192.168.0.11"), "other IPv4 address");
+    check(isAllowed("10.1.0.0/16", "10.1.255.3"), "IPv4 address in network");
+    check(!isAllowed("10.1.0.0/16", "10.2.0.1"), "IPv4 address outside of network");
+    check(isAllowed("10.1.128.0/17", "10.1.200.1") && !isAllowed("10.1.128.0/17", "10.1.100.1"), "IPv4 prefix within a byte");
+    check(isAllowed("192.168.0.10, 10.1.0.0/16", "10.1.0.1") && isAllowed("192.168.0.10\t10.1.0.0/16", "192.168.0.10"), "list of IPv4 entries");
+    check(isAllowed("0.0.0.0/0", "203.0.113.7"), "IPv4 /0 allows every IPv4 sender");
+    check(!isAllowed("0.0.0.0/0", "2001:db8::1"), "IPv4 /0 does not allow IPv6 senders");
+}
+
+void testAllowListV6() {
+    check(isAllowed("fd00::/8", "fd12:3456::1"), "IPv6 address in network");
+    check(!isAllowed("fd00::/8", "fe80::1"), "IPv6 address outside of network");
+    check(isAllowed("2001:db8::1", "2001:db8::1") && !isAllowed("2001:db8::1", "2001:db8::2"), "single IPv6 address");
+    check(isAllowed("::/0", "2001:db8::1") && isAllowed("::/0", "192.168.0.10"), "IPv6 /0 allows every sender");
+    check(!isAllowed("fd00::/8", "192.168.0.10"), "IPv6 network does not allow IPv4 senders");
+    check(!isAllowed("192.168.0.0/24", "2001:db8::1"), "IPv4 network does not allow IPv6 senders");
+}
+
+void testAllowListMapped() {
+    //IPv4 senders on a dual-stack socket arrive IPv4-mapped and must match like plain IPv4 senders
+    check(isAllowed("192.168.0.0/24", "::ffff:192.168.0.10"), "IPv4-mapped sender in IPv4 network");
+    check(!isAllowed("192.168.0.0/24", "::ffff:192.168.1.10"), "IPv4-mapped sender outside of IPv4 network");
+    check(isAllowed("::ffff:192.168.0.0/120", "192.168.0.10"), "IPv4 sender in IPv4-mapped network");
+    check(!isAllowed("::ffff:192.168.0.0/120", "192.168.1.10"), "IPv4 sender outside of IPv4-mapped network");
+}
+
+void testAllowListParse() {
+    AllowList allowList;
+    std::string error;
+    check(!allowList.parse("192.168.0.300", error) && !error.empty(), "invalid address is rejected");
+    check(!allowList.parse("192.168.0.0/33", error), "IPv4 prefix above 32 is rejected");
+    check(!allowList.parse("fd00::/129", error), "IPv6 prefix above 128 is rejected");
+    check(!allowList.parse("10.0.0.0/", error) && !allowList.parse("10.0.0.0/8x", error), "malformed prefix is rejected");
+    check(allowList.parse(" , 10.0.0.0/8 ,, ", error) && !allowList.empty(), "separators around entries are skipped");
+}
+
+void testBurst() {
+    RateLimiter rateLimiter(16, 10, 3);
+    auto sender = getSender("192.168.0.10");
+    int64_t start = 1 * second;
+    bool burst = true;
+    for (int i = 0; i < 3; i++) burst = burst && rateLimiter.acquire(sender, start);
+    check(burst, "burst is accepted at once");
+    check(!rateLimiter.acquire(sender, start), "packet beyond the burst is dropped");
+    check(!rateLimiter.acquire(sender, start + 99 * millisecond), "packet before the next token is dropped");
+    check(rateLimiter.acquire(sender, start + 100 * millisecond), "one token is refilled after the interval");
+    check(!rateLimiter.acquire(sender, start + 100 * millisecond), "only one token is refilled");
+}
+
+void testRefill() {
+    RateLimiter rateLimiter(16, 10, 3);
+    auto sender = getSender("192.168.0.10");
+    int64_t start = 1 * second;
+    for (int i = 0; i < 3; i++) rateLimiter.acquire(sender, start);
+    //After a long pause the bucket is full again, but not fuller than the burst
+    int64_t later = start + 10 * second;
+    bool refilled = true;
+    for (int i = 0; i < 3; i++) refilled = refilled && rateLimiter.acquire(sender, later);
+    check(refilled, "bucket is full again after a pause");
+    check(!rateLimiter.acquire(sender, later), "refill is capped at the burst");
+
+    //A steady sender at the rate is never dropped
+    bool steady = true;
+    for (int i = 1; i <= 100; i++) steady = steady && rateLimiter.acquire(sender, later + i * 100 * millisecond);
+    check(steady, "sender at the rate is accepted");
+}
+
+void testSenders() {
+    RateLimiter rateLimiter(16, 10, 1);
+    int64_t start = 1 * second;
+    check(rateLimiter.acquire(getSender("192.168.0.10", 1000), start), "first sender is accepted");
+    check(!rateLimiter.acquire(getSender("192.168.0.10", 1001), start), "other port shares the bucket of the address");
+    check(rateLimiter.acquire(getSender("192.168.0.11", 1000), start), "other address has its own bucket");
+    check(rateLimiter.acquire(getSender("::ffff:192.168.0.12", 1000), start) && !rateLimiter.acquire(getSender("192.168.0.12", 1000), start), "IPv4-mapped and IPv4 sender share a bucket");
+
+    //More senders than slots, every new sender starts with a full bucket
+    bool accepted = true;
+    for (uint32_t i = 0; i < 256; i++) accepted = accepted && rateLimiter.acquire(getSender(("10.0." + std::to_string(i / 256) + "." + std::to_string(i % 256)).c_str()), start);
+    check(accepted, "new senders are accepted when the table is full");
+}
+
+}
+
+int main() {
+    testAllowListV4();
+    testAllowListV6();
+    testAllowListMapped();
+    testAllowListParse();
+    testBurst();
+    testRefill();
+    testSenders();
+    return Ekey::Test::finish();
+}
@@ -0,0 +1,77 @@
+/* Checks of the store that hands bound sockets over to the next instance of a node.
+ *
+ * Usage: ekey-socket-store-test
+ *
+ * Returns 0 if all checks pass.
+ */
+
+#include "../SocketStore.h"
+#include "Check.h"
+
+#include <sys/socket.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace Ekey;
+using Ekey::Test::check;
+
+namespace {
+
+bool isOpen(int socketDescriptor) {
+    return fcntl(socketDescriptor, F_GETFD) != -1;
+}
+
+void testTake() {
+    auto &store = SocketStore::instance();
+    SocketStore::Key key{"node1", "127.0.0.1", 56000, 0, false};
+    int socketDescriptor = socket(AF_INET, SOCK_DGRAM, 0);
+    store.park(key, socketDescriptor, 42);
+
+    uint32_t dropCount = 0;
+    auto other = key;
+    other.nodeId = "node2";
+    check(store.take(other, dropCount) == -1, "other node does not take the socket");
+    other = key;
+    other.port = 56001;
+    check(store.take(other, dropCount) == -1, "other port does not take the socket");
+    other = key;
+    other.worker = 1;
+    check(store.take(other, dropCount) == -1, "other worker does not take the socket");
+    other = key;
+    other.reusePort = true;
+    check(store.take(other, dropCount) == -1, "socket without SO_REUSEPORT is not taken for workers");
+
+    check(store.take(key, dropCount) == socketDescriptor && dropCount == 42, "same key takes the socket and its drop count");
+    check(isOpen(socketDescriptor), "taken socket stays open");
+    check(store.take(key, dropCount) == -1, "socket is taken only once");
+    close(socketDescriptor);
+}
+
+void testCloseUnused() {
+    auto &store = SocketStore::instance();
+    SocketStore::Key used{"node1", "127.0.0.1", 56000, 0, false};
+    SocketStore::Key unused{"node1", "127.0.0.1", 56001, 0, false};
+    SocketStore::Key otherNode{"node2", "127.0.0.1", 56002, 0, false};
+    int usedSocket = socket(AF_INET, SOCK_DGRAM, 0);
+    int unusedSocket = socket(AF_INET, SOCK_DGRAM, 0);
+    int otherNodeSocket = socket(AF_INET, SOCK_DGRAM, 0);
+    store.park(used, usedSocket, 0);
+    store.park(unused, unusedSocket, 0);
+    store.park(otherNode, otherNodeSocket, 0);
+
+    store.closeUnused("node1", [](const SocketStore::Key &key) { return key.port == 56000; });
+    uint32_t dropCount = 0;
+    check(!isOpen(unusedSocket), "unused socket is closed");
+    check(store.take(used, dropCount) == usedSocket, "used socket is kept");
+    check(store.take(otherNode, dropCount) == otherNodeSocket, "socket of another node is kept");
+    close(usedSocket);
+    close(otherNodeSocket);
+}
+
+}
+
+int main() {
+    testTake();
+    testCloseUnused();
+    return Ekey::Test::finish();
+}
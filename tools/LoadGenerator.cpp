@@ -0,0 +1,184 @@
+/* Loopback load generator for the listen path of the ekey-udp node.
+ *
+ * Usage: ekey-loadgen [--protocol home|multi|rare] [--port 56000] [--rate 10000] [--senders 4] [--duration 10]
+ *                     [--workers 1] [--batchsize 32] [--queuesize 1024] [--overflowpolicy dropoldest]
+ *
+ * The node is started on 127.0.0.1 with its output connected to a local sink instead of a flow. Every sender blasts
+ * converter packets at rate / senders packets per second. The packet number is encoded in the serial number, so the sink
+ * can measure the latency from sendto() to output() for every event. Packets not emitted one second after the last one
+ * was sent are counted as lost.
+ */
+
+#include "../Ekey-Udp.h"
+#include "../Metrics.h"
+
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+struct Settings {
+    std::string protocol = "home";
+    uint16_t port = 56000;
+    uint32_t rate = 10000;
+    uint32_t senders = 4;
+    uint32_t duration = 10;
+    std::map<std::string, std::string> nodeSettings;
+};
+
+int64_t getTime() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+std::string getPacket(const std::string &protocol, uint64_t sequenceNumber) {
+    char serial[24];
+    snprintf(serial, sizeof(serial), "%014llu", (unsigned long long)(sequenceNumber % 100000000000000ull));
+    if (protocol == "multi") return std::string("10003JOSEF----172") + serial + "GAR-1-";
+    if (protocol == "rare") {
+        std::string packet(Ekey::RareLayout::size, '\0');
+        uint32_t value = 3;
+        std::memcpy(&packet[Ekey::RareLayout::version.offset], &value, sizeof(value));
+        value = Ekey::RareLayout::commandOpen;
+        std::memcpy(&packet[Ekey::RareLayout::command.offset], &value, sizeof(value));
+        std::memcpy(&packet[Ekey::RareLayout::terminalSerial.offset], serial, Ekey::RareLayout::terminalSerial.length);
+        return packet;
+    }
+    return std::string("1_0046_4_") + serial + "_1_2";
+}
+
+void sendPackets(const Settings &settings, uint32_t sender, std::atomic<uint64_t> &sequenceNumber, std::vector<std::atomic<int64_t>> &sendTimes, std::atomic<uint64_t> &sent) {
+    int socketDescriptor = socket(AF_INET, SOCK_DGRAM, 0);
+    if (socketDescriptor == -1) {
+        printf("Error: Could not create socket for sender %u: %s\n", sender, strerror(errno));
+        return;
+    }
+
+    sockaddr_in destination{};
+    destination.sin_family = AF_INET;
+    destination.sin_port = htons(settings.port);
+    destination.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    double interval = 1000000000.0 * settings.senders / settings.rate;
+    int64_t start = getTime();
+    int64_t end = start + (int64_t)settings.duration * 1000000000;
+    for (uint64_t i = 0;; i++) {
+        int64_t due = start + (int64_t)(i * interval);
+        if (due >= end) break;
+        while (getTime() < due) std::this_thread::yield();
+
+        uint64_t number = sequenceNumber++;
+        if (number >= sendTimes.size()) break;
+        auto packet = getPacket(settings.protocol, number);
+        sendTimes[number].store(getTime(), std::memory_order_relaxed);
+        if (sendto(socketDescriptor, packet.data(), packet.size(), 0, (sockaddr *)&destination, sizeof(destination)) == (ssize_t)packet.size()) sent++;
+    }
+    close(socketDescriptor);
+}
+
+bool parseArguments(int argc, char **argv, Settings &settings) {
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string name(argv[i]);
+        std::string value(argv[i + 1]);
+        if (name == "--protocol") settings.protocol = value;
+        else if (name == "--port") settings.port = (uint16_t)std::strtoul(value.c_str(), nullptr, 10);
+        else if (name == "--rate") settings.rate = (uint32_t)std::strtoul(value.c_str(), nullptr, 10);
+        else if (name == "--senders") settings.senders = (uint32_t)std::strtoul(value.c_str(), nullptr, 10);
+        else if (name == "--duration") settings.duration = (uint32_t)std::strtoul(value.c_str(), nullptr, 10);
+        else if (name.compare(0, 2, "--") == 0) settings.nodeSettings[name.substr(2)] = value;
+        else return false;
+    }
+    return (argc % 2) == 1 && settings.rate > 0 && settings.senders > 0 && settings.duration > 0;
+}
+
+}
+
+int main(int argc, char **argv) {
+    Settings settings;
+    if (!parseArguments(argc, argv, settings)) {
+        printf("Usage: %s [--protocol home|multi|rare] [--port 56000] [--rate 10000] [--senders 4] [--duration 10] [--<node setting> <value>]\n", argv[0]);
+        return 1;
+    }
+
+    uint64_t packetCount = (uint64_t)settings.rate * settings.duration;
+    std::vector<std::atomic<int64_t>> sendTimes(packetCount);
+    std::atomic<uint64_t> sequenceNumber{0};
+    std::atomic<uint64_t> sent{0};
+    std::atomic<uint64_t> received{0};
+    Ekey::LatencyHistogram latency;
+
+    std::atomic_bool frontendConnected{false};
+    Ekey::Ekey node("loadgen", "ekey-udp", &frontendConnected);
+    node.setLog([](const std::string &nodeId, int32_t logLevel, const std::string &message) {
+        if (logLevel <= 3) printf("%s\n", message.c_str());
+    });
+    auto receive = [&](const Flows::PVariable &message, int64_t now) {
+        auto payloadIterator = message->structValue->find("payload");
+        if (payloadIterator == message->structValue->end()) return;
+        auto serialIterator = payloadIterator->second->structValue->find("serialNr");
+        if (serialIterator == payloadIterator->second->structValue->end()) return;
+        //payloadtype compact outputs the serial number as integer
+        uint64_t number = serialIterator->second->type == Flows::VariableType::tInteger64 ? (uint64_t)serialIterator->second->integerValue64 : std::strtoull(serialIterator->second->stringValue.c_str(), nullptr, 10);
+        if (number >= sendTimes.size()) return;
+        latency.record((uint64_t)(now - sendTimes[number].load(std::memory_order_relaxed)));
+        received++;
+    };
+    node.setOutput([&](const std::string &nodeId, uint32_t index, Flows::PVariable message, bool synchronous) {
+        if (index != 0) return;
+        int64_t now = getTime();
+        auto payloadIterator = message->structValue->find("payload");
+        if (payloadIterator == message->structValue->end()) return;
+        //With outputbatchsize > 1 the payload is an array of events
+        if (payloadIterator->second->type == Flows::VariableType::tArray) {
+            for (auto &event : *payloadIterator->second->arrayValue) {
+                receive(event, now);
+            }
+        } else receive(message, now);
+    });
+
+    auto nodeInfo = std::make_shared<Flows::NodeInfo>();
+    nodeInfo->info = std::make_shared<Flows::Variable>(Flows::VariableType::tStruct);
+    nodeInfo->info->structValue->emplace("listenaddress", std::make_shared<Flows::Variable>(std::string("127.0.0.1")));
+    nodeInfo->info->structValue->emplace("listenport", std::make_shared<Flows::Variable>(std::to_string(settings.port)));
+    nodeInfo->info->structValue->emplace("protocol", std::make_shared<Flows::Variable>(settings.protocol));
+    nodeInfo->info->structValue->emplace("metricsinterval", std::make_shared<Flows::Variable>(std::string("0")));
+    for (auto &nodeSetting : settings.nodeSettings) {
+        (*nodeInfo->info->structValue)[nodeSetting.first] = std::make_shared<Flows::Variable>(nodeSetting.second);
+    }
+    if (!node.init(nodeInfo) || !node.start()) {
+        printf("Error: Could not start node.\n");
+        return 1;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+
+    printf("Sending %llu %s packets from %u senders to port %u at %u packets/s...\n", (unsigned long long)packetCount, settings.protocol.c_str(), settings.senders, settings.port, settings.rate);
+    int64_t start = getTime();
+    std::vector<std::thread> senders;
+    for (uint32_t i = 0; i < settings.senders; i++) {
+        senders.emplace_back(&sendPackets, std::cref(settings), i, std::ref(sequenceNumber), std::ref(sendTimes), std::ref(sent));
+    }
+    for (auto &sender : senders) {
+        sender.join();
+    }
+    int64_t sendEnd = getTime();
+
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+    node.stop();
+    node.waitForStop();
+
+    double seconds = (sendEnd - start) / 1000000000.0;
+    uint64_t lost = sent > received ? sent - received : 0;
+    printf("Sent:     %llu packets (%.0f packets/s)\n", (unsigned long long)sent.load(), sent / seconds);
+    printf("Received: %llu packets (%.0f packets/s)\n", (unsigned long long)received.load(), received / seconds);
+    printf("Lost:     %llu packets (%.3f %%)\n", (unsigned long long)lost, sent > 0 ? lost * 100.0 / sent : 0.0);
+    printf("Latency:  p50 %.1f us, p99 %.1f us, p999 %.1f us, max %.1f us\n", latency.getValueAtQuantile(0.5) / 1000.0, latency.getValueAtQuantile(0.99) / 1000.0, latency.getValueAtQuantile(0.999) / 1000.0, latency.max() / 1000.0);
+    return 0;
+}
@@ -0,0 +1,175 @@
+/* Microbenchmark for the packet decoders of the ekey-parser library.
+ *
+ * Usage: ekey-parser-bench [iterations]
+ *
+ * Every decoder runs over a corpus of valid packets and a corpus of malformed packets (wrong length, invalid digits).
+ * The batch decoders run over the same corpora in batches of 64 packets, the HOME decoder with every instruction set the
+ * CPU supports.
+ * Protocol detection runs over a mix of all three formats. The result is printed as nanoseconds per packet.
+ */
+
+#include "../BatchDecoder.h"
+#include "../PacketParser.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace Ekey;
+
+namespace {
+
+constexpr size_t corpusSize = 4096;
+constexpr size_t batchSize = 64;
+
+std::string getDigits(std::mt19937 &random, size_t length) {
+    std::string result;
+    for (size_t i = 0; i < length; i++) {
+        result.push_back((char)('0' + random() % 10));
+    }
+    return result;
+}
+
+std::string getHomePacket(std::mt19937 &random) {
+    static const char fingers[] = "0123456789R-";
+    static const char relays[] = "1234d-";
+    std::string packet = "1_" + getDigits(random, 4) + "_";
+    packet.push_back(fingers[random() % (sizeof(fingers) - 1)]);
+    packet += "_" + getDigits(random, 14) + "_";
+    packet.push_back((char)('1' + random() % 2));
+    packet.push_back('_');
+    packet.push_back(relays[random() % (sizeof(relays) - 1)]);
+    return packet;
+}
+
+std::string getMultiPacket(std::mt19937 &random) {
+    static const char fingers[] = "0123456789-";
+    static const char actions[] = "12345678AB";
+    static const char inputs[] = "1234-";
+    std::string packet = "1" + getDigits(random, 4) + "JOSEF----";
+    packet.push_back((char)('0' + random() % 2));
+    packet.push_back(fingers[random() % (sizeof(fingers) - 1)]);
+    packet.push_back(inputs[random() % (sizeof(inputs) - 1)]);
+    packet += getDigits(random, 14) + "GAR-";
+    packet.push_back(actions[random() % (sizeof(actions) - 1)]);
+    packet.push_back(inputs[random() % (sizeof(inputs) - 1)]);
+    return packet;
+}
+
+std::string getRarePacket(std::mt19937 &random) {
+    std::string packet(RareLayout::size, '\0');
+    auto store = [&](Field field, uint32_t value) {
+        std::memcpy(&packet[field.offset], &value, field.length);
+    };
+    store(RareLayout::version, 3);
+    store(RareLayout::command, random() % 2 ? RareLayout::commandOpen : RareLayout::commandRefuse);
+    store(RareLayout::terminalId, RareLayout::terminalAddressBase + (((random() % 30) * 53 + random() % 53) << 16) + random() % 10000);
+    packet[RareLayout::relayId.offset] = (char)(random() % 3);
+    store(RareLayout::userId, random() % 100);
+    store(RareLayout::finger, random() % 10);
+    std::memcpy(&packet[RareLayout::event.offset], "EVENT", 5);
+    std::memcpy(&packet[RareLayout::time.offset], "12:00:00", 8);
+    return packet;
+}
+
+std::string corrupt(std::mt19937 &random, std::string packet) {
+    if (random() % 2) packet.pop_back();
+    else packet[random() % packet.size()] = 'x';
+    return packet;
+}
+
+template<typename Packet>
+void run(const char *name, const std::vector<std::string> &corpus, ParseError (*parse)(std::string_view, Packet &), uint32_t iterations) {
+    Packet packet;
+    uint64_t errors = 0;
+    uint64_t checksum = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < iterations; i++) {
+        for (auto &data : corpus) {
+            if (parse(data, packet) != ParseError::none) errors++;
+            else checksum += (uint64_t)packet.userId + (uint64_t)packet.fingerId;
+        }
+    }
+    auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    uint64_t packets = (uint64_t)iterations * corpus.size();
+    printf("%-28s %12lu packets %8.2f ns/packet %8.2f Mpackets/s %6.1f %% errors (checksum %lu)\n", name, (unsigned long)packets, (double)elapsed / packets, packets * 1000.0 / elapsed, errors * 100.0 / packets, (unsigned long)checksum);
+}
+
+template<typename Columns>
+void runBatch(const char *name, const std::vector<std::string> &corpus, void (*decode)(const std::string_view *, size_t, Columns &), uint32_t iterations, bool perInstructionSet) {
+    std::vector<std::string_view> packets(corpus.begin(), corpus.end());
+    for (auto instructionSet : {InstructionSet::scalar, InstructionSet::sse2, InstructionSet::avx2}) {
+        if (!BatchDecoder::setInstructionSet(instructionSet)) continue;
+        if (!perInstructionSet && instructionSet != InstructionSet::scalar) break;
+        Columns columns;
+        uint64_t errors = 0;
+        uint64_t checksum = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (uint32_t i = 0; i < iterations; i++) {
+            for (size_t offset = 0; offset < packets.size(); offset += batchSize) {
+                size_t count = std::min(batchSize, packets.size() - offset);
+                decode(packets.data() + offset, count, columns);
+                for (size_t row = 0; row < count; row++) {
+                    if (columns.error[row] != ParseError::none) errors++;
+                    else checksum += (uint64_t)columns.userId[row] + (uint64_t)columns.fingerId[row];
+                }
+            }
+        }
+        auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+        uint64_t count = (uint64_t)iterations * packets.size();
+        std::string label = perInstructionSet ? std::string(name) + " " + std::string(BatchDecoder::getInstructionSetName(instructionSet)) : std::string(name);
+        printf("%-28s %12lu packets %8.2f ns/packet %8.2f Mpackets/s %6.1f %% errors (checksum %lu)\n", label.c_str(), (unsigned long)count, (double)elapsed / count, count * 1000.0 / elapsed, errors * 100.0 / count, (unsigned long)checksum);
+    }
+}
+
+void runDetection(const char *name, const std::vector<std::string> &corpus, uint32_t iterations) {
+    uint64_t errors = 0;
+    uint64_t checksum = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < iterations; i++) {
+        for (auto &data : corpus) {
+            Protocol protocol;
+            if (!PacketParser::detectProtocol(data, protocol)) errors++;
+            else checksum += (uint64_t)protocol;
+        }
+    }
+    auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    uint64_t packets = (uint64_t)iterations * corpus.size();
+    printf("%-28s %12lu packets %8.2f ns/packet %8.2f Mpackets/s %6.1f %% errors (checksum %lu)\n", name, (unsigned long)packets, (double)elapsed / packets, packets * 1000.0 / elapsed, errors * 100.0 / packets, (unsigned long)checksum);
+}
+
+}
+
+int main(int argc, char **argv) {
+    uint32_t iterations = argc > 1 ? (uint32_t)std::strtoul(argv[1], nullptr, 10) : 1000;
+    std::mt19937 random(311);
+
+    std::vector<std::string> home, malformedHome, multi, malformedMulti, rare, malformedRare, mixed;
+    for (size_t i = 0; i < corpusSize; i++) {
+        home.push_back(getHomePacket(random));
+        malformedHome.push_back(corrupt(random, home.back()));
+        multi.push_back(getMultiPacket(random));
+        malformedMulti.push_back(corrupt(random, multi.back()));
+        rare.push_back(getRarePacket(random));
+        malformedRare.push_back(rare.back().substr(0, random() % RareLayout::size));
+        mixed.push_back(random() % 2 ? home.back() : random() % 2 ? multi.back() : rare.back());
+    }
+
+    run("home", home, &PacketParser::parseHome, iterations);
+    run("home malformed", malformedHome, &PacketParser::parseHome, iterations);
+    run("multi", multi, &PacketParser::parseMulti, iterations);
+    run("multi malformed", malformedMulti, &PacketParser::parseMulti, iterations);
+    runBatch("home batch", home, &BatchDecoder::decodeHome, iterations, true);
+    runBatch("home batch malformed", malformedHome, &BatchDecoder::decodeHome, iterations, true);
+    runBatch("multi batch", multi, &BatchDecoder::decodeMulti, iterations, false);
+    runBatch("multi batch malformed", malformedMulti, &BatchDecoder::decodeMulti, iterations, false);
+    run("rare", rare, &PacketParser::parseRare, iterations);
+    run("rare malformed", malformedRare, &PacketParser::parseRare, iterations);
+    runDetection("detect mixed", mixed, iterations);
+    return 0;
+}